@@ -8,9 +8,13 @@
 #include <memory>
 #include <limits>
 #include <optional>
+#include <tuple>
 #include <array>
 #include <random>
 #include <type_traits>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
 
 // We use std::set as a reference to check our implementation.
 // It is not available in progtest :)
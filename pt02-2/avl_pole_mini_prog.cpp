@@ -8,9 +8,14 @@
 #include <memory>
 #include <limits>
 #include <optional>
+#include <tuple>
 #include <array>
 #include <random>
 #include <type_traits>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <numeric>
 
 // We use std::vector as a reference to check our implementation.
 // It is not available in progtest :)
@@ -98,6 +103,35 @@ struct Array {
         return ret;
     }
 
+    // Elements from index k on move to the returned array. O(log n) like concat and splice.
+    Array split_at(size_t k) {
+        assertIndex(k);
+        Array rest;
+        tree.splitAt(k, rest.tree);
+        return rest;
+    }
+
+    // Appends all of other, other is left empty.
+    void concat(Array &other) {
+        tree.concat(other.tree);
+    }
+
+    // Moves the len elements at from so they start at index to of the array without them.
+    void splice(size_t from, size_t len, size_t to) {
+        if (from > size() || len > size() - from || to > size() - len)
+            throw std::out_of_range("Splice out of range " + std::to_string(from) + "+" + std::to_string(len) +
+                                    " to " + std::to_string(to) + " size is " + std::to_string(size()));
+        tree.splice(from, len, to);
+    }
+
+    auto begin() { return tree.begin(); }
+
+    auto end() { return tree.end(); }
+
+    auto begin() const { return tree.begin(); }
+
+    auto end() const { return tree.end(); }
+
     tree_t tree;
 
     // Needed to test the structure of the tree.
@@ -122,6 +156,8 @@ struct Array {
 
 #ifndef __PROGTEST__
 
+#include "counted_btree.hpp"
+
 struct TestFailed : std::runtime_error {
     using std::runtime_error::runtime_error;
 };
@@ -141,7 +177,7 @@ std::string fmt(const char *f, ...) {
     return buf;
 }
 
-template<typename T>
+template<typename T, typename A = Array<T>>
 struct Tester {
     Tester() = default;
 
@@ -186,6 +222,15 @@ struct Tester {
     }
 
     void check_tree() const {
+        if constexpr (std::is_same_v<A, Array<T>>) {
+            check_avl();
+        } else {
+            // no binary tree to walk, compare the elements
+            for (size_t i = 0; i < size(); i++) operator[](i);
+        }
+    }
+
+    void check_avl() const {
         using TI = typename Array<T>::TesterInterface;
         auto ref_it = ref.begin();
         bool check_value_failed = false;
@@ -231,7 +276,7 @@ struct Tester {
         throw TestFailed(fmt("%s: ref %s.", msg, s ? "succeeded" : "failed"));
     }
 
-    Array<T> tested;
+    A tested;
     Ref<T> ref;
 };
 
@@ -276,8 +321,9 @@ enum RandomTestFlags : unsigned {
     SEQ = 1, NO_ERASE = 2, CHECK_TREE = 4
 };
 
+template<typename A = Array<size_t>>
 void test_random(size_t size, unsigned flags = 0) {
-    Tester<size_t> t;
+    Tester<size_t, A> t;
     std::mt19937 my_rand(24707 + size);
 
     bool seq = flags & SEQ;
@@ -314,6 +360,407 @@ void test_random(size_t size, unsigned flags = 0) {
     t.check_tree();
 }
 
+void test_iterators() {
+    static_assert(std::random_access_iterator<decltype(std::declval<Array<int>>().begin())>);
+    static_assert(std::random_access_iterator<decltype(std::declval<const Array<int>>().begin())>);
+
+    Array<int> a;
+    if (a.begin() != a.end()) throw TestFailed("Iterators: empty array.");
+    std::vector<int> ref;
+    std::mt19937 my_rand(11);
+    for (int i = 0; i < 3000; i++) {
+        size_t pos = my_rand() % (ref.size() + 1);
+        a.insert(pos, i);
+        ref.insert(ref.begin() + pos, i);
+    }
+
+    const Array<int> &c = a;
+    if (!std::equal(c.begin(), c.end(), ref.begin(), ref.end())) throw TestFailed("Iterators: scan mismatch.");
+    if (!std::equal(std::make_reverse_iterator(c.end()), std::make_reverse_iterator(c.begin()), ref.rbegin()))
+        throw TestFailed("Iterators: reverse scan mismatch.");
+
+    for (auto &x: a) x *= 2;
+    for (auto &x: ref) x *= 2;
+
+    for (int i = 0; i < 1000; i++) {
+        std::ptrdiff_t from = my_rand() % (ref.size() + 1), to = my_rand() % (ref.size() + 1);
+        auto it = a.begin() + from;
+        if (it - a.begin() != from || (it + (to - from)) - it != to - from)
+            throw TestFailed("Iterators: distance mismatch.");
+        if ((it < a.begin() + to) != (from < to)) throw TestFailed("Iterators: order mismatch.");
+        if (to < std::ptrdiff_t(ref.size()) && it[to - from] != ref[to]) throw TestFailed("Iterators: jump mismatch.");
+    }
+    if (std::distance(a.begin(), a.end()) != std::ptrdiff_t(ref.size())) throw TestFailed("Iterators: size mismatch.");
+}
+
+void test_splice() {
+    using TI = Array<int>::TesterInterface;
+    Tester<int> checker;
+    auto check = [&](const Array<int> &a, const std::vector<int> &ref) {
+        if (!std::equal(a.begin(), a.end(), ref.begin(), ref.end())) throw TestFailed("Splice: content mismatch.");
+        auto ignore = [](int) {};
+        checker.check_node(TI::root(&a), decltype(TI::root(&a))(nullptr), ignore);
+    };
+
+    std::mt19937 my_rand(5);
+    Array<int> a;
+    std::vector<int> ref;
+    for (int i = 0; i < 5000; i++) {
+        a.insert(i, i);
+        ref.push_back(i);
+    }
+
+    for (int i = 0; i < 300; i++) {
+        switch (my_rand() % 3) {
+            case 0: {
+                size_t from = my_rand() % (ref.size() + 1);
+                size_t len = my_rand() % (ref.size() - from + 1);
+                size_t to = my_rand() % (ref.size() - len + 1);
+                a.splice(from, len, to);
+                std::vector<int> block(ref.begin() + from, ref.begin() + from + len);
+                ref.erase(ref.begin() + from, ref.begin() + from + len);
+                ref.insert(ref.begin() + to, block.begin(), block.end());
+                break;
+            }
+            case 1: {
+                size_t k = my_rand() % (ref.size() + 1);
+                Array<int> rest = a.split_at(k);
+                std::vector<int> restRef(ref.begin() + k, ref.end());
+                ref.resize(k);
+                check(a, ref);
+                check(rest, restRef);
+                for (int j = 0; j < 50; j++) {
+                    size_t pos = my_rand() % (restRef.size() + 1);
+                    rest.insert(pos, -j);
+                    restRef.insert(restRef.begin() + pos, -j);
+                    if (restRef.size() > 1) {
+                        pos = my_rand() % restRef.size();
+                        rest.erase(pos);
+                        restRef.erase(restRef.begin() + pos);
+                    }
+                }
+                if (my_rand() % 2) {
+                    a.concat(rest);
+                    ref.insert(ref.end(), restRef.begin(), restRef.end());
+                    if (rest.size()) throw TestFailed("Splice: concat left elements behind.");
+                }
+                break;
+            }
+            default: {
+                Array<int> other;
+                std::vector<int> otherRef;
+                for (int j = 0; j < int(my_rand() % 100); j++) {
+                    other.insert(j, 1'000'000 + j);
+                    otherRef.push_back(1'000'000 + j);
+                }
+                other.concat(a);
+                otherRef.insert(otherRef.end(), ref.begin(), ref.end());
+                a.concat(other);
+                ref = otherRef;
+            }
+        }
+        check(a, ref);
+    }
+
+    try {
+        a.splice(0, a.size() + 1, 0);
+        throw TestFailed("Splice: out of range accepted.");
+    } catch (const std::out_of_range &) {}
+}
+
+template<typename Node>
+int check_lazy_node(const Node *n, const Node *p) {
+    if (!n) return 0;
+    if (n->parent != p) throw TestFailed("Range: parent mismatch.");
+    int l = check_lazy_node(n->left, n), r = check_lazy_node(n->right, n);
+    if (abs(l - r) > 1) throw TestFailed("Range: tree is not avl balanced.");
+    return std::max(l, r) + 1;
+}
+
+void test_range_updates() {
+    LazyAVLTree<long long> t;
+    std::vector<long long> ref;
+    std::mt19937 my_rand(3);
+    for (int i = 0; i < 500; i++) {
+        t.insert(i, i);
+        ref.push_back(i);
+    }
+
+    for (int i = 0; i < 20000; i++) {
+        size_t from = my_rand() % (ref.size() + 1);
+        size_t count = my_rand() % (ref.size() - from + 1);
+        auto first = ref.begin() + from, last = first + count;
+        long long x = (long long) (my_rand() % 201) - 100;
+        switch (my_rand() % 9) {
+            case 0:
+                t.add(from, count, x);
+                for (auto it = first; it != last; ++it) *it += x;
+                break;
+            case 1:
+                t.assign(from, count, x);
+                std::fill(first, last, x);
+                break;
+            case 2:
+                t.reverse(from, count);
+                std::reverse(first, last);
+                break;
+            case 3:
+                if (t.sum(from, count) != std::accumulate(first, last, 0LL)) throw TestFailed("Range: sum mismatch.");
+                break;
+            case 4:
+                if (count && t.min(from, count) != *std::min_element(first, last))
+                    throw TestFailed("Range: min mismatch.");
+                break;
+            case 5:
+                t.insert(from, x);
+                ref.insert(first, x);
+                break;
+            case 6:
+                if (from < ref.size()) {
+                    if (t.erase(from) != ref[from]) throw TestFailed("Range: erase mismatch.");
+                    ref.erase(first);
+                }
+                break;
+            default:
+                if (from < ref.size() && t.get(from) != ref[from]) throw TestFailed("Range: get mismatch.");
+        }
+        if (t.getSize() != ref.size()) throw TestFailed("Range: size mismatch.");
+        if (i % 1000 == 0) check_lazy_node(t.root, decltype(t.root)(nullptr));
+    }
+    for (size_t i = 0; i < ref.size(); i++)
+        if (t.get(i) != ref[i]) throw TestFailed(fmt("Range: element %zu mismatch.", i));
+
+    try {
+        t.sum(ref.size(), 1);
+        throw TestFailed("Range: out of range accepted.");
+    } catch (const std::out_of_range &) {}
+}
+
+struct IsEven {
+    size_t operator()(int value) const { return value % 2 == 0; }
+};
+
+// Small nodes so splits, merges and root changes happen all the time.
+// No default constructor, alive counts the objects which were constructed and not destroyed yet.
+struct Tracked {
+    static inline long alive = 0;
+
+    explicit Tracked(int value) : value(value) { alive++; }
+
+    Tracked(const Tracked &other) : value(other.value) { alive++; }
+
+    Tracked(Tracked &&other) noexcept: value(other.value) { alive++; }
+
+    Tracked &operator=(const Tracked &) = default;
+
+    Tracked &operator=(Tracked &&) = default;
+
+    ~Tracked() { alive--; }
+
+    int value;
+};
+
+void test_btree_storage() {
+    {
+        CountedBTree<Tracked, 4, 4> t;
+        std::mt19937 my_rand(13);
+        for (int i = 0; i < 3000; i++) t.insert(my_rand() % (t.getSize() + 1), Tracked(i));
+        for (int i = 0; i < 2000; i++) t.remove(my_rand() % t.getSize());
+        if (Tracked::alive != long(t.getSize())) throw TestFailed(fmt("BTree: %ld values alive.", Tracked::alive));
+    }
+    if (Tracked::alive) throw TestFailed(fmt("BTree: %ld values leaked.", Tracked::alive));
+}
+
+void test_btree() {
+    CountedBTree<int, 4, 4, IsEven> t;
+    std::vector<int> ref;
+    std::mt19937 my_rand(9);
+    auto evens = [&](size_t count) { return size_t(std::count_if(ref.begin(), ref.begin() + count, IsEven{})); };
+
+    for (int i = 0; i < 40000; i++) {
+        size_t pos = my_rand() % (ref.size() + 1);
+        int value = int(my_rand() % 1000);
+        switch (my_rand() % (i < 20000 ? 4 : 7)) {
+            case 0:
+            case 1:
+                t.insert(pos, value);
+                ref.insert(ref.begin() + pos, value);
+                break;
+            case 2:
+                if (pos < ref.size()) {
+                    t.set(pos, value);
+                    ref[pos] = value;
+                }
+                break;
+            default:
+                if (pos < ref.size()) {
+                    if (t.remove(pos) != ref[pos]) throw TestFailed("BTree: remove mismatch.");
+                    ref.erase(ref.begin() + pos);
+                }
+        }
+        if (t.getSize() != ref.size() || t.getSize<1>() != evens(ref.size()))
+            throw TestFailed("BTree: size mismatch.");
+        if (!ref.empty()) {
+            pos = my_rand() % ref.size();
+            if (t.find(pos) != ref[pos]) throw TestFailed("BTree: find mismatch.");
+            if (t.countBefore<1>(pos) != evens(pos)) throw TestFailed("BTree: count mismatch.");
+        }
+        if (t.getSize<1>()) {
+            size_t even = my_rand() % t.getSize<1>();
+            auto [value, offset] = t.locate<1>(even);
+            size_t index = t.indexOf<1>(even);
+            size_t expected = 0;
+            while (ref[expected] % 2 || even--) expected++;
+            if (*value != ref[expected] || offset) throw TestFailed("BTree: weighted find mismatch.");
+            if (index != expected) throw TestFailed("BTree: indexOf mismatch.");
+        }
+    }
+
+    CountedBTree<int, 4, 4, IsEven> built;
+    built.assign(ref.begin(), ref.end());
+    for (int i = 0; i < 2000; i++) {
+        size_t pos = my_rand() % (ref.size() + 1);
+        built.insert(pos, i);
+        ref.insert(ref.begin() + pos, i);
+        pos = my_rand() % ref.size();
+        if (built.remove(pos) != ref[pos]) throw TestFailed("BTree: remove after assign mismatch.");
+        ref.erase(ref.begin() + pos);
+    }
+    if (built.getSize() != ref.size() || built.getSize<1>() != evens(ref.size()))
+        throw TestFailed("BTree: size after assign mismatch.");
+    for (size_t i = 0; i < ref.size(); i++)
+        if (built.find(i) != ref[i] || built.countBefore<1>(i) != evens(i))
+            throw TestFailed("BTree: assign mismatch.");
+
+    CountedBTree<int> plain;
+    for (int i = 0; i < 5000; i++) plain.insert(plain.getSize() / 2, i);
+    for (size_t i = 0; i < plain.getSize(); i++) plain.find(i) = int(i);
+    for (size_t i = 0; i < plain.getSize(); i++)
+        if (plain.find(i) != int(i)) throw TestFailed("BTree: plain mismatch.");
+    try {
+        plain.remove(plain.getSize());
+        throw TestFailed("BTree: out of range accepted.");
+    } catch (const std::out_of_range &) {}
+}
+
+template<typename T_Node>
+using Utf8LeadCounter = typename PredicateSizeCounter<IsUtf8Lead>::template Inner<T_Node>;
+
+// Bytes of UTF-8 text, one per node, indexed by byte through SizeCounter and by code point through Utf8LeadCounter.
+using Utf8Node = mixins::Mixins<
+        ValueNode<char>::template Inner,
+        ParentNode,
+        GetIndex,
+        BubbleUp,
+        DeferredUpdate,
+        BinaryNode,
+        InOrder,
+        MaxDepth,
+        Utf8LeadCounter,
+        SizeCounter,
+        Indexable,
+        InsertAt,
+        Equals>;
+
+using Utf8Tree = mixins::Mixins<
+        TreeMixer<Utf8Node>::template Inner,
+        TreeMixer<Utf8Node>::template Arena,
+        TreeMixer<Utf8Node>::template Indexable,
+        TreeMixer<Utf8Node>::template InsertAt,
+        TreeMixer<Utf8Node>::template Delete,
+        TreeMixer<Utf8Node>::template Size,
+        TreeMixer<Utf8Node>::template Rotator,
+        TreeMixer<Utf8Node>::template Balancer>;
+
+// find<leads>(k) is the lead byte of code point k, getIndex<leads> of a lead byte is its code point + 1.
+void test_predicate_counter() {
+    constexpr auto leads = &Utf8LeadCounter<Utf8Node>::size;
+    const char bytes[] = {'a', '\n', '\t', char(0xC3), char(0xA9), char(0xE2), char(0x82), char(0xAC), char(0xF0)};
+    Utf8Tree tree;
+    std::string ref;
+    std::mt19937 my_rand(11);
+
+    for (int i = 0; i < 3000; i++) {
+        if (ref.empty() || my_rand() % 3) {
+            size_t pos = my_rand() % (ref.size() + 1);
+            char c = bytes[my_rand() % std::size(bytes)];
+            tree.insert(pos, c);
+            ref.insert(ref.begin() + std::ptrdiff_t(pos), c);
+        } else {
+            size_t pos = my_rand() % ref.size();
+            tree.remove(tree.find(pos));
+            ref.erase(ref.begin() + std::ptrdiff_t(pos));
+        }
+        if (i % 100 != 99) continue;
+
+        size_t cp = 0;
+        for (size_t pos = 0; pos < ref.size(); pos++) {
+            if (!IsUtf8Lead::test(ref[pos])) continue;
+            const auto &node = tree.find<leads>(cp);
+            if (&node != &tree.find(pos)) throw TestFailed(fmt("Predicate: code point %zu not at %zu.", cp, pos));
+            if (node.getIndex<leads>() != cp + 1 || node.getIndex() != pos + 1)
+                throw TestFailed(fmt("Predicate: wrong index of code point %zu.", cp));
+            cp++;
+        }
+        if (ref.empty()) continue;
+        if (tree.root->*leads != cp) throw TestFailed("Predicate: code point count mismatch.");
+        try {
+            tree.find<leads>(cp);
+            throw TestFailed("Predicate: code point out of range accepted.");
+        } catch (const std::out_of_range &) {}
+    }
+}
+
+// Counts copies, elements have to be moved into the tree and stay where they are until erased.
+struct Counted {
+    static inline size_t copies = 0;
+
+    Counted(int value = 0) : value(value) {}
+
+    Counted(const Counted &other) : value(other.value) { copies++; }
+
+    Counted(Counted &&) = default;
+
+    Counted &operator=(const Counted &other) {
+        value = other.value;
+        copies++;
+        return *this;
+    }
+
+    Counted &operator=(Counted &&) = default;
+
+    // AugmentedNode counts newlines of its values
+    friend bool operator==(const Counted &counted, char c) { return counted.value == c; }
+
+    int value;
+};
+
+void test_stable() {
+    Array<Counted> a;
+    std::vector<int> ref;
+    std::mt19937 my_rand(7);
+    for (int i = 0; i < 2000; i++) {
+        size_t pos = my_rand() % (ref.size() + 1);
+        a.insert(pos, Counted(i));
+        ref.insert(ref.begin() + pos, i);
+    }
+
+    std::vector<const Counted *> addresses;
+    for (size_t i = 0; i < a.size(); i++) addresses.push_back(&a[i]);
+
+    for (int i = 0; i < 1000; i++) {
+        size_t pos = my_rand() % ref.size();
+        if (a.erase(pos).value != ref[pos]) throw TestFailed("Stable: erase mismatch.");
+        ref.erase(ref.begin() + pos);
+        addresses.erase(addresses.begin() + pos);
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (&a[i] != addresses[i]) throw TestFailed(fmt("Stable: element %zu moved.", i));
+        if (a[i].value != ref[i]) throw TestFailed(fmt("Stable: element %zu mismatch.", i));
+    }
+    if (Counted::copies) throw TestFailed(fmt("Stable: %zu copies.", Counted::copies));
+}
+
 int main() {
     try {
         std::cout << "Insert test..." << std::endl;
@@ -334,6 +781,28 @@ int main() {
         std::cout << "Bigger sequential test..." << std::endl;
         test_random(5'000, SEQ);
 
+        std::cout << "Iterator test..." << std::endl;
+        test_iterators();
+
+        std::cout << "Split, concat and splice test..." << std::endl;
+        test_splice();
+
+        std::cout << "Range update test..." << std::endl;
+        test_range_updates();
+
+        std::cout << "Counted B-tree test..." << std::endl;
+        test_btree();
+        test_btree_storage();
+        test_random<BTreeArray<size_t, 4, 4>>(200);
+        test_random<BTreeArray<size_t>>(5'000);
+        test_random<BTreeArray<size_t, 4, 4>>(5'000, SEQ);
+
+        std::cout << "Predicate counter test..." << std::endl;
+        test_predicate_counter();
+
+        std::cout << "Stable references test..." << std::endl;
+        test_stable();
+
         std::cout << "All tests passed." << std::endl;
     } catch (const TestFailed &e) {
         std::cout << "Test failed: " << e.what() << std::endl;
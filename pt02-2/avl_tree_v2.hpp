@@ -1,32 +1,7 @@
+#pragma once
+
 // region mixins
 namespace detail {
-    template<typename... Args>
-    struct next_type;
-
-    template<typename Current, typename Second, typename... Rest>
-    struct next_type<Current, Current, Second, Rest...> {
-        using type = Second;
-        static constexpr bool value = true;
-    };
-
-    template<typename Current, typename Second, typename... Rest>
-    struct next_type<Current, Second, Rest...> {
-        using type = typename next_type<Current, Rest...>::type;
-        static constexpr bool value = next_type<Current, Rest...>::value;
-    };
-
-    template<typename T>
-    struct next_type<T> {
-        using type = T;
-        static constexpr bool value = false;
-    };
-
-    template<typename ...T>
-    using next_type_t = typename next_type<T...>::type;
-
-    template<typename ...T>
-    constexpr bool next_type_v = next_type<T...>::value;
-
     template<typename T>
     concept NumericType = std::integral<T> || std::floating_point<T>;
 
@@ -58,33 +33,82 @@ int get_sign(T t) {
 }
 
 namespace mixins {
+    // Mixins which only help debugging (GraphViz output, node labels), release builds leave them out.
+    template<template<typename> typename M>
+    inline constexpr bool is_debug_mixin = false;
+
+#ifdef NDEBUG
+    inline constexpr bool keep_debug_mixins = false;
+#else
+    inline constexpr bool keep_debug_mixins = true;
+#endif
+
+    // Compile time plan of a mixin list: which mixins are kept, in declaration order, and the order their data is
+    // laid out in. Bases are placed in the order they are inherited, so listing them by decreasing alignment keeps
+    // the padding between the small fields (a char value, the depth byte) to the single tail of the node.
+    // The sort is stable, mixins of the same alignment keep their relative order.
+    template<typename Final, template<typename> typename ...T_mixins>
+    struct Layout {
+        static constexpr size_t total = sizeof...(T_mixins);
+        static constexpr bool kept[total] = {(keep_debug_mixins || !is_debug_mixin<T_mixins>)...};
+        static constexpr size_t align[total] = {alignof(T_mixins<Final>)...};
+        static constexpr size_t count = (size_t(keep_debug_mixins || !is_debug_mixin<T_mixins>) + ...);
+
+        struct Order {
+            size_t at[count ? count : 1];
+        };
+
+        static constexpr Order declared = [] {
+            Order order{};
+            for (size_t i = 0, k = 0; i < total; ++i)
+                if (kept[i]) order.at[k++] = i;
+            return order;
+        }();
+
+        static constexpr Order placed = [] {
+            Order order = declared;
+            for (size_t i = 1; i < count; ++i)
+                for (size_t j = i; j && align[order.at[j - 1]] < align[order.at[j]]; --j)
+                    std::swap(order.at[j - 1], order.at[j]);
+            return order;
+        }();
+
+        template<size_t I>
+        using Nth = std::tuple_element_t<I, std::tuple<T_mixins<Final>...>>;
+    };
+
+    template<typename Plan, typename Indices>
+    struct Bases;
+
+    template<typename Plan, size_t ...I>
+    struct Bases<Plan, std::index_sequence<I...>> : Plan::template Nth<Plan::placed.at[I]> ... {
+        // The mixin bases in declaration order, ExecAll folds over them.
+        using mixin_types = std::tuple<typename Plan::template Nth<Plan::declared.at[I]>...>;
+    };
+
+    template<typename M>
+    concept Destroys = requires(M &mixin) { mixin.destroy(); };
+
     template<template<typename> typename ...T_mixins>
-    struct Mixins : T_mixins<Mixins<T_mixins...>> ... {
+    struct Mixins : Bases<Layout<Mixins<T_mixins...>, T_mixins...>,
+            std::make_index_sequence<Layout<Mixins<T_mixins...>, T_mixins...>::count>> {
+        Mixins() = default;
 
-        template<size_t N>
-        using N_type = std::tuple_element_t<N, std::tuple<T_mixins<Mixins<T_mixins...>>...>>;
+        Mixins(const Mixins &) = default;
 
-        template<class Current>
-        using Next_type = detail::next_type_t<Current, T_mixins<Mixins<T_mixins...>>...>;
+        Mixins(Mixins &&) = default;
 
-        template<size_t N>
-        constexpr decltype(auto) get() {
-            return *static_cast<N_type<N> *>(this);
-        }
+        Mixins &operator=(const Mixins &) = default;
 
-        constexpr decltype(auto) first() {
-            return get<0>();
-        }
+        Mixins &operator=(Mixins &&) = default;
 
-        template<typename Current>
-        constexpr decltype(auto) next() {
-            return *static_cast<Next_type<Current> *>(this);
+        // Calls destroy() of every mixin having one while all the bases are still alive, their own destructors run
+        // in the order Layout placed them in. Without such a mixin it stays trivial whenever the bases are.
+        ~Mixins() requires (Destroys<T_mixins<Mixins>> || ...) {
+            destroyAll(*this);
         }
 
-        template<typename Current>
-        static constexpr decltype(auto) hasNext() {
-            return detail::next_type_v<Current, T_mixins<Mixins<T_mixins...>>...>;
-        }
+        ~Mixins() = default;
     };
 
     template<typename K, template<typename> typename Current>
@@ -105,53 +129,48 @@ namespace mixins {
 
 // region execAll macro
 
+// Generates FunName(self, args...) calling Function(args...) on every mixin of self which has it, and
+// FunName##Ret(self, lambda, args...) which in addition passes every non void result to lambda.
+// The dispatch is a single fold over Mixins::mixin_types, mixins without Function are dropped at compile time,
+// so after inlining it is straight line code.
 #define ExecAll(FunName, Function) \
 namespace mixins {\
+    template<typename Current, typename T, typename Lambda, typename...Args>\
+    void _##FunName##Ret(T &self, Lambda &lambda, Args &...args) {\
+        using Base = detail::const_if_const<T, Current>;\
+        if constexpr (requires(Base &base) { { base.Function(std::declval<Args &>()...) } -> std::same_as<void>; }) {\
+            static_cast<Base &>(self).Function(args...);\
+        } else if constexpr (requires(Base &base) { base.Function(std::declval<Args &>()...); }) {\
+            lambda(static_cast<Base &>(self).Function(args...));\
+        }\
+    }\
+    \
+    template<typename T, typename Lambda, typename...Current, typename...Args>\
+    void _##FunName##Ret(T &self, Lambda &lambda, std::tuple<Current...> *, Args &...args) {\
+        (_##FunName##Ret<Current>(self, lambda, args...), ...);\
+    }\
+    \
     template<typename T, typename Lambda, typename...Args>\
     void FunName##Ret(T &&self, Lambda &&lambda, Args &&...args) {\
-        _##FunName##Ret<T, Lambda, typename std::remove_reference_t<T>::template N_type<0>, Args...>(std::forward<T>(self),\
-                                                                                                std::forward<Lambda>(\
-                                                                                                        lambda),\
-                                                                                                std::forward<Args>(\
-                                                                                                        args)...);\
+        _##FunName##Ret(self, lambda, (typename std::remove_cvref_t<T>::mixin_types *) nullptr, args...);\
     }\
     \
-    template<typename T, typename...Args>\
-    void FunName(T &&self, Args &&...args) {\
-        _##FunName<T, typename std::remove_reference_t<T>::template N_type<0>, Args...>(std::forward<T>(self),\
-                                                                                        std::forward<Args>(args)...);\
+    template<typename Current, typename T, typename...Args>\
+    void _##FunName(T &self, Args &...args) {\
+        using Base = detail::const_if_const<T, Current>;\
+        if constexpr (requires(Base &base) { base.Function(std::declval<Args &>()...); }) {\
+            static_cast<Base &>(self).Function(args...);\
+        }\
     }\
     \
-    template<typename T, typename Lambda, typename Current, typename...Args>\
-    void _##FunName##Ret(T &&self, Lambda &&lambda, Args &&...args) {\
-        if constexpr (std::remove_reference_t<T>::template hasNext<Current>()) {\
-            _##FunName##Ret<T, Lambda, typename std::remove_reference_t<T>::template Next_type<Current>>(\
-                    std::forward<T>(self), std::forward<Lambda>(lambda), std::forward<Args>(args)...);\
-        }\
-        if constexpr (requires(T &&t) {\
-            {\
-            static_cast<detail::const_if_const<std::remove_reference_t<T>,Current> &&>(t).Function(std::forward<Args>(args)...)\
-            }->std::same_as<void>;\
-        }) { static_cast<detail::const_if_const<std::remove_reference_t<T>,Current> &&>(self).Function(std::forward<Args>(args)...); }\
-        else if constexpr (requires(T &&t) {\
-            {\
-            static_cast<detail::const_if_const<std::remove_reference_t<T>,Current> &&>(t).Function(std::forward<Args>(args)...)\
-            };\
-        }) { lambda(static_cast<detail::const_if_const<std::remove_reference_t<T>,Current> &&>(self).Function(std::forward<Args>(args)...)); }\
+    template<typename T, typename...Current, typename...Args>\
+    void _##FunName(T &self, std::tuple<Current...> *, Args &...args) {\
+        (_##FunName<Current>(self, args...), ...);\
     }\
     \
-    template<typename T, typename Current, typename...Args>\
-    void _##FunName(T &&self, Args &&...args) {\
-        if constexpr (std::remove_reference_t<T>::template hasNext<Current>()) {\
-            _##FunName<T, typename std::remove_reference_t<T>::template Next_type<Current>>(std::forward<T>(self),\
-                                                                                            std::forward<Args>(\
-                                                                                                    args)...);\
-        }\
-        if constexpr (requires(T &&t) {\
-            {\
-            static_cast<detail::const_if_const<std::remove_reference_t<T>,Current> &&>(t).Function(std::forward<Args>(args)...)\
-            };\
-        }) { static_cast<detail::const_if_const<std::remove_reference_t<T>,Current> &&>(self).Function(std::forward<Args>(args)...); }\
+    template<typename T, typename...Args>\
+    void FunName(T &&self, Args &&...args) {\
+        _##FunName(self, (typename std::remove_cvref_t<T>::mixin_types *) nullptr, args...);\
     }\
 }
 
@@ -160,6 +179,8 @@ namespace mixins {\
 ExecAll(updateAll, update)
 ExecAll(mixinInfoAll, mixinInfo)
 ExecAll(copyAll, copy)
+ExecAll(pushAll, push)
+ExecAll(destroyAll, destroy)
 
 
 enum class Direction {
@@ -191,27 +212,19 @@ struct BubbleUp : mixins::SureIAmThat<T_Node, BubbleUp> {
     }
 };
 
+// Marker mixin, setValue and setChild of nodes with it do not bubbleUp. The tree operations leave the path from the
+// edited node to the root dirty and run one fused update and rebalance pass over it (see TreeMixer::updateUp).
+template<typename T_Node>
+struct DeferredUpdate : mixins::SureIAmThat<T_Node, DeferredUpdate> {
+};
+
 template<typename T_Node>
 struct BinaryNode : mixins::SureIAmThat<T_Node, BinaryNode> {
     using mixins::SureIAmThat<T_Node, BinaryNode>::self;
 
-private:
-
-    static void _removeChild(T_Node *node) {
-        if (!node) return;
-        node->left = node->right = nullptr;
-        delete node;
-    }
-
-public:
-
+    // Nodes do not own their children, the tree allocates and frees them (see TreeMixer::Inner).
     BinaryNode() = default;
 
-    ~BinaryNode() {
-        delete left;
-        delete right;
-    }
-
     BinaryNode(const BinaryNode &) = delete;
 
     BinaryNode &operator=(const BinaryNode &) = delete;
@@ -246,17 +259,15 @@ public:
     requires mixins::Mixin<T_Node, BubbleUp>
     T_Node *setChild(T_Node *child) {
         if constexpr (direction == Direction::left) {
-            _removeChild(left);
             left = child;
         } else {
-            _removeChild(right);
             right = child;
         }
         if (child != nullptr) {
             child->parent = &self();
-            child->bubbleUp();
-        } else {
-            self().bubbleUp();
+        }
+        if constexpr (!mixins::Mixin<T_Node, DeferredUpdate>) {
+            (child ? child : &self())->bubbleUp();
         }
         return child;
     }
@@ -310,6 +321,45 @@ Direction getChildDirection(const T_Node *child) {
     return Direction::right;
 }
 
+template<typename T_Node>
+struct InOrder : mixins::SureIAmThat<T_Node, InOrder> {
+    using mixins::SureIAmThat<T_Node, InOrder>::self;
+
+    const T_Node *next() const {
+        const T_Node *current = &self();
+        if (current->right) {
+            current = current->right;
+            while (current->left)
+                current = current->left;
+            return current;
+        }
+        while (current->parent && current->parent->right == current)
+            current = current->parent;
+        return current->parent;
+    }
+
+    const T_Node *prev() const {
+        const T_Node *current = &self();
+        if (current->left) {
+            current = current->left;
+            while (current->right)
+                current = current->right;
+            return current;
+        }
+        while (current->parent && current->parent->left == current)
+            current = current->parent;
+        return current->parent;
+    }
+
+    T_Node *next() {
+        return const_cast<T_Node *>(detail::as_const(*this).next());
+    }
+
+    T_Node *prev() {
+        return const_cast<T_Node *>(detail::as_const(*this).prev());
+    }
+};
+
 template<typename T_Node>
 struct Debug : mixins::SureIAmThat<T_Node, Debug> {
     using mixins::SureIAmThat<T_Node, Debug>::self;
@@ -391,6 +441,12 @@ public:
 
 };
 
+template<>
+inline constexpr bool mixins::is_debug_mixin<Debug> = true;
+
+template<>
+inline constexpr bool mixins::is_debug_mixin<GraphViz> = true;
+
 template<typename T>
 struct ValueNode {
     template<typename T_Node>
@@ -415,7 +471,7 @@ struct ValueNode {
 
         T_Node &setValue(T value) {
             _value = std::move(value);
-            if constexpr (requires { requires mixins::Mixin<T_Node, BubbleUp>; }) {
+            if constexpr (requires { requires mixins::Mixin<T_Node, BubbleUp> && !mixins::Mixin<T_Node, DeferredUpdate>; }) {
                 self().bubbleUp();
             }
             return self();
@@ -467,14 +523,15 @@ struct SizeCounter : mixins::SureIAmThat<T_Node, SizeCounter> {
 template<typename T_Node>
 constexpr auto NormalSize = &SizeCounter<T_Node>::size;
 
-template<typename T, T filter>
+// The counters below sum in Width, a narrower one shrinks every node of a tree known to stay small enough for it.
+template<typename T, T filter, typename Width = size_t>
 struct FilteredSizeCounter {
     template<typename T_Node>
     struct Inner : mixins::SureIAmThat<T_Node, Inner> {
         using mixins::SureIAmThat<T_Node, Inner>::self;
 
         void update() {
-            size = getSize<&T_Node::left>() + getSize<&T_Node::right>() + (self().getValue() == filter);
+            size = Width(getSize<&T_Node::left>() + getSize<&T_Node::right>() + (self().getValue() == filter));
         }
 
         template<auto direction>
@@ -488,7 +545,155 @@ struct FilteredSizeCounter {
             return "f[" + std::to_string(filter) + "]: " + std::to_string(size);
         }
 
-        size_t size = 0;
+        Width size = 0;
+    };
+};
+
+// Sums weight (a const member function of the value) over the subtree, e.g. the characters of text chunks.
+template<auto weight, typename Width = size_t>
+struct WeightedSizeCounter {
+    template<typename T_Node>
+    struct Inner : mixins::SureIAmThat<T_Node, Inner> {
+        using mixins::SureIAmThat<T_Node, Inner>::self;
+
+        void update() {
+            size = Width(getSize<&T_Node::left>() + getSize<&T_Node::right>() + (self().getValue().*weight)());
+        }
+
+        template<auto direction>
+        size_t getSize() {
+            if (self().*direction)
+                return (self().*direction)->Inner<T_Node>::size;
+            return 0;
+        }
+
+        std::string mixinInfo() const {
+            return "w: " + std::to_string(size);
+        }
+
+        Width size = 0;
+    };
+};
+
+// Counts the values for which Predicate::test holds, FilteredSizeCounter for a whole class of values.
+template<typename Predicate, typename Width = size_t>
+struct PredicateSizeCounter {
+    template<typename T_Node>
+    struct Inner : mixins::SureIAmThat<T_Node, Inner> {
+        using mixins::SureIAmThat<T_Node, Inner>::self;
+
+        void update() {
+            size = Width(getSize<&T_Node::left>() + getSize<&T_Node::right>() +
+                         bool(Predicate::test(self().getValue())));
+        }
+
+        template<auto direction>
+        size_t getSize() {
+            if (self().*direction)
+                return (self().*direction)->Inner<T_Node>::size;
+            return 0;
+        }
+
+        std::string mixinInfo() const {
+            return "p: " + std::to_string(size);
+        }
+
+        Width size = 0;
+    };
+};
+
+// Sum and minimum of the values in the subtree, kept current under range updates by LazyUpdate.
+template<typename T>
+struct RangeAggregate {
+    template<typename T_Node>
+    struct Inner : mixins::SureIAmThat<T_Node, Inner> {
+        using mixins::SureIAmThat<T_Node, Inner>::self;
+
+        void update() {
+            sum = minimum = self().getValue();
+            if (self().left) {
+                sum += self().left->Inner<T_Node>::sum;
+                minimum = std::min(minimum, self().left->Inner<T_Node>::minimum);
+            }
+            if (self().right) {
+                sum += self().right->Inner<T_Node>::sum;
+                minimum = std::min(minimum, self().right->Inner<T_Node>::minimum);
+            }
+        }
+
+        std::string mixinInfo() const {
+            return "sum: " + better_to_string(sum) + " min: " + better_to_string(minimum);
+        }
+
+        T sum{}, minimum{};
+    };
+};
+
+// Range update of a subtree, every value x becomes (assign ? assigned : x) + add, reverse mirrors the order.
+template<typename T>
+struct RangeTag {
+    T add{};
+    T assigned{};
+    bool assign = false;
+    bool reverse = false;
+
+    // This tag followed by next.
+    void then(const RangeTag &next) {
+        if (next.assign) {
+            assign = true;
+            assigned = next.assigned;
+            add = next.add;
+        } else {
+            add += next.add;
+        }
+        reverse ^= next.reverse;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return !assign && !reverse && add == T{};
+    }
+};
+
+// Lazy range updates. apply updates the node, its RangeAggregate and the order of its children right away and
+// leaves the tag pending for the children, push hands it one level down. Everything touching the children of a
+// node has to push it first, SplitJoin and Rotator do (pushAll is a no-op for trees without this mixin).
+template<typename T>
+struct LazyUpdate {
+    template<typename T_Node>
+    struct Inner : mixins::SureIAmThat<T_Node, Inner> {
+        using mixins::SureIAmThat<T_Node, Inner>::self;
+
+        void apply(const RangeTag<T> &tag) {
+            T &value = self().getValue();
+            if (tag.assign)
+                value = tag.assigned;
+            value += tag.add;
+            if constexpr (mixins::Mixin<T_Node, RangeAggregate<T>::template Inner>) {
+                auto &aggregate = static_cast<typename RangeAggregate<T>::template Inner<T_Node> &>(self());
+                T size = T(self().SizeCounter<T_Node>::size);
+                if (tag.assign) {
+                    aggregate.sum = tag.assigned * size;
+                    aggregate.minimum = tag.assigned;
+                }
+                aggregate.sum += tag.add * size;
+                aggregate.minimum += tag.add;
+            }
+            if (tag.reverse)
+                std::swap(self().left, self().right);
+            pending.then(tag);
+        }
+
+        void push() {
+            if (pending.empty())
+                return;
+            if (self().left)
+                self().left->apply(pending);
+            if (self().right)
+                self().right->apply(pending);
+            pending = {};
+        }
+
+        RangeTag<T> pending;
     };
 };
 
@@ -497,7 +702,7 @@ struct MaxDepth : mixins::SureIAmThat<T_Node, MaxDepth> {
     using mixins::SureIAmThat<T_Node, MaxDepth>::self;
 
     void update() {
-        maxDepth = std::max(getDepth<&T_Node::left>(), getDepth<&T_Node::right>()) + 1;
+        maxDepth = uint8_t(std::max(getDepth<&T_Node::left>(), getDepth<&T_Node::right>()) + 1);
     }
 
     template<auto direction>
@@ -519,7 +724,14 @@ struct MaxDepth : mixins::SureIAmThat<T_Node, MaxDepth> {
         return get_sign(getDelta());
     }
 
-    size_t maxDepth = 0;
+    // AVL trees with 2^64 nodes are less than 93 levels deep.
+    uint8_t maxDepth = 0;
+};
+
+template<typename T_Node>
+struct NodeOffset {
+    T_Node *node;
+    size_t offset;
 };
 
 template<typename T_Node>
@@ -527,74 +739,68 @@ struct Indexable : mixins::SureIAmThat<T_Node, Indexable> {
     using mixins::SureIAmThat<T_Node, Indexable>::self;
 
 private:
+    // Every node weighs exactly one under SizeCounter, the only counter of that member pointer type.
+    // NormalSize is a constexpr variable, its decltype is const.
     template<auto size_counter>
-    const T_Node &_find(size_t index) const {
+    static constexpr bool _unitWeight =
+            std::is_same_v<decltype(size_counter), std::remove_cv_t<decltype(NormalSize<T_Node>)>>;
+
+    // Single descent, one read of the left size per level. The own weight of a node is 1 for SizeCounter, other
+    // counters (filtered or weighted) derive it from the node total and the right size. The left/right choice is
+    // written as selects, only the rarely taken "found" branch is left for the predictor.
+    template<auto size_counter>
+    NodeOffset<const T_Node> _locate(size_t index) const {
+        static_assert(_unitWeight<NormalSize<T_Node>>, "SizeCounter lookups have to skip the right child");
         const T_Node *current = &self();
         while (true) {
-            if (index == _currentIndex<size_counter>(current)) {
-                if (_isCurrent<size_counter>(current))
-                    return *current;
-                if (index == _size<size_counter>(current->left)) {
-                    current = current->left;
-                    continue;
-                } else if (index == _size<size_counter>(current->left)) {
-                    current = current->right;
-                    continue;
-                }
-            }
-
-            if (index < _currentIndex<size_counter>(current)) {
-                current = current->left;
-            } else /* if (index > _currentIndex<size_counter>(current)) */ {
-                index -= _currentIndex<size_counter>(current);
-                current = current->right;
+            size_t left = current->left ? (*current->left).*size_counter : 0;
+            size_t own;
+            if constexpr (_unitWeight<size_counter>) {
+                own = 1;
+                // Both children start loading while the left size is compared, as the right size read does below.
+                __builtin_prefetch(current->right);
+            } else {
+                own = current->*size_counter - left - (current->right ? (*current->right).*size_counter : 0);
             }
+            if (index - left < own && index >= left)
+                return {current, index - left};
+            bool goLeft = index < left;
+            index -= goLeft ? 0 : left + own;
+            current = goLeft ? current->left : current->right;
         }
     }
 
     template<auto size_counter>
-    T_Node &_find(size_t index) {
-        return const_cast<T_Node &>(detail::as_const(*this).template _find<size_counter>(index));
+    void _checkIndex(size_t index) const {
+        if (index >= self().*size_counter)
+            throw std::out_of_range("Index out of range " + std::to_string(index) + " maximum is " +
+                                    std::to_string(self().*size_counter));
     }
 
-    template<auto size_counter>
-    size_t _size(const T_Node *current) const {
-        if (!current) return 0;
-        return current->*size_counter;
-    }
+public:
 
     template<auto size_counter>
-    size_t _currentIndex(const T_Node *current) const {
-        if (!current) return 0;
-        size_t index = current->*size_counter;
-        if (current->right)
-            index -= (*current->right).*size_counter;
-        return index;
+    const T_Node &find(size_t index) const {
+        _checkIndex<size_counter>(index);
+        return *_locate<size_counter>(index).node;
     }
 
     template<auto size_counter>
-    bool _isCurrent(const T_Node *current) const {
-        size_t subCount = 0;
-        if (current->right)
-            subCount += (*current->right).*size_counter;
-        if (current->left)
-            subCount += (*current->left).*size_counter;
-        return subCount != current->*size_counter;
+    T_Node &find(size_t index) {
+        return const_cast<T_Node &>(detail::as_const(*this).template find<size_counter>(index));
     }
 
-public:
-
+    // Node whose own weight covers index and the offset of index inside it, for counters whose nodes weigh more than 1.
     template<auto size_counter>
-    const T_Node &find(size_t index) const {
-        if (index >= self().*size_counter)
-            throw std::out_of_range("Index out of range " + std::to_string(index) + " maximum is " +
-                                    std::to_string(self().*size_counter));
-        return _find<size_counter>(index + 1);
+    NodeOffset<const T_Node> locate(size_t index) const {
+        _checkIndex<size_counter>(index);
+        return _locate<size_counter>(index);
     }
 
     template<auto size_counter>
-    T_Node &find(size_t index) {
-        return const_cast<T_Node &>(detail::as_const(*this).template find<size_counter>(index));
+    NodeOffset<T_Node> locate(size_t index) {
+        auto [node, offset] = detail::as_const(*this).template locate<size_counter>(index);
+        return {const_cast<T_Node *>(node), offset};
     }
 };
 
@@ -626,6 +832,17 @@ public:
         }
         return index;
     }
+
+    // Weight of everything in front of this node, getIndex counts the node itself as well.
+    template<auto size_counter = NormalSize<T_Node>>
+    [[nodiscard]] size_t getOffset() const {
+        size_t own = self().*size_counter;
+        if (self().left)
+            own -= (*self().left).*size_counter;
+        if (self().right)
+            own -= (*self().right).*size_counter;
+        return getIndex<size_counter>() - own;
+    }
 };
 
 
@@ -633,18 +850,15 @@ template<typename T_Node>
 struct Insert : mixins::SureIAmThat<T_Node, Insert> {
     using mixins::SureIAmThat<T_Node, Insert>::self;
 
-    T_Node &insert(const T_Node &node) {
-        Direction direction = Direction::right;
-        T_Node *toInsert = &self();
-        while (toInsert->getChild(direction)) {
-            toInsert = toInsert->getChild(direction);
-            direction = Direction::left;
-        }
-        auto aux = new T_Node();
-        copyAll(*aux, self());
-        toInsert->setChild(direction, std::move(aux));
-        copyAll(self(), node);
-        return *toInsert->getChild(direction);
+    // Links the detached node right in front of self, as the last node of the left subtree. Nothing is copied,
+    // every node already in the tree keeps its value.
+    T_Node &insert(T_Node *node) {
+        T_Node *toInsert = self().left;
+        if (!toInsert)
+            return *self().template setChild<Direction::left>(node);
+        while (toInsert->right)
+            toInsert = toInsert->right;
+        return *toInsert->template setChild<Direction::right>(node);
     }
 };
 
@@ -653,15 +867,12 @@ template<typename T_Node>
 struct PushBack : mixins::SureIAmThat<T_Node, PushBack> {
     using mixins::SureIAmThat<T_Node, PushBack>::self;
 
-    T_Node &pushBack(const T_Node &node) {
+    T_Node &pushBack(T_Node *node) {
         T_Node *toInsert = &self();
         while (toInsert->template getChild<Direction::right>()) {
             toInsert = toInsert->template getChild<Direction::right>();
         }
-        auto aux = new T_Node();
-        copyAll(*aux, node);
-        toInsert->template setChild<Direction::right>(std::move(aux));
-        return *toInsert->right;
+        return *toInsert->template setChild<Direction::right>(node);
     }
 };
 
@@ -670,11 +881,11 @@ struct InsertAt : mixins::SureIAmThat<T_Node, InsertAt>, PushBack<T_Node>, Inser
     using mixins::SureIAmThat<T_Node, InsertAt>::self;
 
     template<auto size_counter>
-    T_Node &insert(size_t index, const T_Node &node) {
+    T_Node &insert(size_t index, T_Node *node) {
         if (index == self().*size_counter)
-            return self().pushBack(std::move(node));
+            return self().pushBack(node);
         auto &toInsert = self().template find<size_counter>(index);
-        return toInsert.Insert<T_Node>::insert(std::move(node));
+        return toInsert.Insert<T_Node>::insert(node);
     }
 };
 
@@ -683,6 +894,38 @@ template<typename T_Node>
 struct TreeMixer {
     static constexpr auto default_size_counter = NormalSize<T_Node>;
 
+    // Single update pass after a structural edit below node. The rebalancing already runs updateAll on every node up
+    // to the root, without a Balancer DeferredUpdate nodes get the bubbleUp they skipped. Eager nodes are up to date.
+    template<typename T_Tree>
+    static void updateUp(T_Tree &tree, T_Node *node) {
+        if constexpr (requires { requires mixins::Mixin<T_Tree, Balancer>; }) {
+            tree.balanceUp(node);
+        } else if constexpr (mixins::Mixin<T_Node, DeferredUpdate>) {
+            if (node)
+                node->bubbleUp();
+        }
+    }
+
+    // Visits every node of a detached subtree without recursion or a stack and leaves it unlinked. Left children
+    // are rotated up until the node has none, then it goes to visit (which may free it) and its right subtree is
+    // next, every node is rotated at most once. Parent pointers are not touched.
+    template<typename Visit>
+    static void dismantle(T_Node *node, Visit &&visit) {
+        while (node) {
+            if (T_Node *left = node->left) {
+                node->left = left->right;
+                left->right = node;
+                node = left;
+            } else {
+                T_Node *right = node->right;
+                node->right = nullptr;
+                visit(node);
+                node = right;
+            }
+        }
+    }
+
+    // Nodes come from the Arena mixin when the tree has one, from new and delete otherwise.
     template<typename T_Tree>
     struct Inner : mixins::SureIAmThat<T_Tree, Inner> {
         using mixins::SureIAmThat<T_Tree, Inner>::self;
@@ -691,13 +934,196 @@ struct TreeMixer {
 
         Inner() = default;
 
-        ~Inner() {
-            delete root;
+        Inner(Inner &&other) noexcept: root(other.root) {
+            other.root = nullptr;
         }
 
         Inner(const Inner &) = delete;
 
         Inner &operator=(const Inner &) = delete;
+
+        T_Node *createNode() {
+            if constexpr (mixins::Mixin<T_Tree, Arena>) {
+                return self().allocate();
+            } else {
+                return new T_Node();
+            }
+        }
+
+        // Frees a single node, its children are left alone.
+        void destroyNode(T_Node *node) {
+            if constexpr (mixins::Mixin<T_Tree, Arena>) {
+                self().deallocate(node);
+            } else {
+                delete node;
+            }
+        }
+
+        // Frees a detached subtree.
+        void destroyNodes(T_Node *node) {
+            dismantle(node, [this](T_Node *current) { destroyNode(current); });
+        }
+
+        // Lets nodes move between this tree and other.
+        void shareAllocator(T_Tree &other) {
+            if constexpr (mixins::Mixin<T_Tree, Arena>) {
+                self().sharePool(other);
+            }
+        }
+
+        // Frees every node, with an Arena in a single release.
+        void clear() {
+            if constexpr (mixins::Mixin<T_Tree, Arena>) {
+                self().release();
+            } else {
+                destroyNodes(root);
+                root = nullptr;
+            }
+        }
+
+        // Run by the destructor of the tree, where the Arena is still there whichever base Layout put first.
+        void destroy() {
+            clear();
+        }
+    };
+
+    // Per tree slab allocator. Nodes are carved out of slabs of growing size and recycled through a free list,
+    // releasing the tree drops the slabs without visiting the nodes unless they have a destructor to run. Trees
+    // exchanging nodes (SplitJoin::splitAt, concat) merge their pools first, the slabs then live until the last of
+    // those trees is gone.
+    template<typename T_Tree>
+    struct Arena : mixins::SureIAmThat<T_Tree, Arena> {
+        using mixins::SureIAmThat<T_Tree, Arena>::self;
+
+    private:
+        union Slot {
+            Slot *next;
+            alignas(T_Node) unsigned char node[sizeof(T_Node)];
+        };
+
+        // Slab sizes in slots, growth stops at 1 MB whatever the node size.
+        static constexpr size_t _maxSlab = std::max(size_t(1), (size_t(1) << 20) / sizeof(Slot));
+        static constexpr size_t _firstSlab = std::min(size_t(64), _maxSlab);
+
+        struct Pool {
+            // Newest slab, slot 0 of every slab links the previous one.
+            Slot *slabs = nullptr, *oldest = nullptr;
+            Slot *free = nullptr, *lastFree = nullptr;
+            size_t used = 0, capacity = 0;
+            // Set once merged into another pool, which owns the slabs from then on.
+            std::shared_ptr<Pool> forward;
+
+            Pool() = default;
+
+            ~Pool() {
+                while (slabs) {
+                    Slot *previous = slabs->next;
+                    delete[] slabs;
+                    slabs = previous;
+                }
+            }
+
+            Pool(const Pool &) = delete;
+
+            Pool &operator=(const Pool &) = delete;
+        };
+
+        std::shared_ptr<Pool> _pool;
+
+        Pool &_resolve() {
+            if (!_pool)
+                _pool = std::make_shared<Pool>();
+            while (_pool->forward)
+                _pool = _pool->forward;
+            return *_pool;
+        }
+
+    public:
+        Arena() = default;
+
+        Arena(Arena &&) noexcept = default;
+
+        Arena(const Arena &) = delete;
+
+        Arena &operator=(const Arena &) = delete;
+
+        T_Node *allocate() {
+            Pool &pool = _resolve();
+            Slot *slot = pool.free;
+            if (slot) {
+                pool.free = slot->next;
+                if (!pool.free)
+                    pool.lastFree = nullptr;
+            } else {
+                if (pool.used == pool.capacity) {
+                    size_t size = pool.capacity ? std::min(2 * pool.capacity, _maxSlab) : _firstSlab;
+                    Slot *slab = new Slot[size + 1];
+                    slab->next = pool.slabs;
+                    pool.slabs = slab;
+                    if (!pool.oldest)
+                        pool.oldest = slab;
+                    pool.used = 0;
+                    pool.capacity = size;
+                }
+                slot = pool.slabs + 1 + pool.used++;
+            }
+            return new(slot->node) T_Node();
+        }
+
+        void deallocate(T_Node *node) {
+            Pool &pool = _resolve();
+            node->~T_Node();
+            Slot *slot = reinterpret_cast<Slot *>(node);
+            slot->next = pool.free;
+            if (!pool.free)
+                pool.lastFree = slot;
+            pool.free = slot;
+        }
+
+        // From now on this tree and other allocate from one pool, so nodes may move between them. O(1), what is
+        // left of the newest slab of other is not used any more.
+        void sharePool(T_Tree &other) {
+            Arena &them = other;
+            Pool &mine = _resolve();
+            Pool &theirs = them._resolve();
+            if (&mine == &theirs)
+                return;
+            if (theirs.slabs) {
+                if (mine.oldest) {
+                    mine.oldest->next = theirs.slabs;
+                } else {
+                    mine.slabs = theirs.slabs;
+                    mine.used = theirs.used;
+                    mine.capacity = theirs.capacity;
+                }
+                mine.oldest = theirs.oldest;
+            }
+            if (theirs.free) {
+                theirs.lastFree->next = mine.free;
+                if (!mine.free)
+                    mine.lastFree = theirs.lastFree;
+                mine.free = theirs.free;
+            }
+            theirs.slabs = theirs.oldest = theirs.free = theirs.lastFree = nullptr;
+            theirs.forward = _pool;
+            them._pool = _pool;
+        }
+
+        // Frees every node of the tree and empties it, in a single release unless another tree shares the pool.
+        void release() {
+            if (_pool) {
+                _resolve();
+                if (_pool.use_count() == 1) {
+                    if constexpr (!std::is_trivially_destructible_v<T_Node>) {
+                        dismantle(self().root, [](T_Node *node) { node->~T_Node(); });
+                    }
+                    _pool = nullptr;
+                } else {
+                    self().destroyNodes(self().root);
+                }
+            }
+            self().root = nullptr;
+        }
     };
 
 
@@ -709,7 +1135,9 @@ struct TreeMixer {
             Direction revDirection = direction == Direction::left ? Direction::right : Direction::left;
             auto pivot = node;
             auto parent = node->parent;
+            pushAll(*pivot);
             auto child = node->getChild(revDirection);
+            pushAll(*child);
             auto grandChild = child->getChild(direction);
 
             if (parent) {
@@ -796,26 +1224,38 @@ struct TreeMixer {
         T_Node &find(size_t index) {
             return const_cast<T_Node &>(detail::as_const(*this).template find<size_counter>(index));
         }
-    };
 
-    template<typename T_Tree>
-    struct InsertAt : mixins::SureIAmThat<T_Tree, InsertAt> {
+        template<auto size_counter = default_size_counter>
+        NodeOffset<const T_Node> locate(size_t index) const {
+            if (!self().root)
+                throw std::out_of_range("Index out of range " + std::to_string(index) + " tree is empty");
+            return detail::as_const(*self().root).template locate<size_counter>(index);
+        }
+
+        template<auto size_counter = default_size_counter>
+        NodeOffset<T_Node> locate(size_t index) {
+            auto [node, offset] = detail::as_const(*this).template locate<size_counter>(index);
+            return {const_cast<T_Node *>(node), offset};
+        }
+    };
+
+    template<typename T_Tree>
+    struct InsertAt : mixins::SureIAmThat<T_Tree, InsertAt> {
         using mixins::SureIAmThat<T_Tree, InsertAt>::self;
 
+        // The value is moved into a new node which is linked in, nodes already in the tree are not touched.
         template<auto size_counter = default_size_counter>
-        T_Node &insert(size_t index, const std::decay_t<decltype(std::declval<T_Node>().getValue())> &data) {
-            T_Node newNode;
-            newNode.setValue(data);
+        T_Node &insert(size_t index, std::decay_t<decltype(std::declval<T_Node>().getValue())> value) {
+            T_Node *node = self().createNode();
+            node->setValue(std::move(value));
 
             if (!self().root) {
-                self().root = new T_Node();
-                copyAll(*self().root, newNode);
-                return *self().root;
-            }
-            T_Node &inserted = self().root->template insert<size_counter>(index, std::move(newNode));
-            if constexpr (requires { requires mixins::Mixin<T_Tree, Balancer>; }) {
-                self().balanceUp(&inserted);
+                self().root = node;
+                updateAll(*node);
+                return *node;
             }
+            T_Node &inserted = self().root->template insert<size_counter>(index, node);
+            updateUp(self(), &inserted);
             return inserted;
         }
     };
@@ -827,11 +1267,11 @@ struct TreeMixer {
     private:
         T_Node *_insert(const std::decay_t<decltype(std::declval<T_Node>().getValue())> &value) {
             if (!self().root) {
-                self().root = new T_Node();
+                self().root = self().createNode();
                 return &self().root->setValue(value);
             }
 
-            auto *newNode = new T_Node();
+            auto *newNode = self().createNode();
             newNode->setValue(value);
 
             T_Node *current = self().root;
@@ -849,7 +1289,7 @@ struct TreeMixer {
                         return current->template setChild<Direction::left>(newNode);
                     }
                 } else {
-                    delete newNode;
+                    self().destroyNode(newNode);
                     return nullptr;
                 }
             }
@@ -859,9 +1299,7 @@ struct TreeMixer {
         bool insert(const std::decay_t<decltype(std::declval<T_Node>().getValue())> &value) {
             T_Node *inserted = _insert(value);
             if (inserted) {
-                if constexpr (requires { requires mixins::Mixin<T_Tree, Balancer>; }) {
-                    self().balanceUp(inserted);
-                }
+                updateUp(self(), inserted);
                 return true;
             }
             return false;
@@ -911,43 +1349,258 @@ struct TreeMixer {
     struct Delete : mixins::SureIAmThat<T_Tree, Delete> {
         using mixins::SureIAmThat<T_Tree, Delete>::self;
 
-        void remove(T_Node &node) {
+    private:
+        // Puts with (may be nullptr) where node hangs in the tree.
+        void _replace(T_Node &node, T_Node *with) {
             T_Node *parent = node.parent;
-            if (node.childCount() == 0) {
-                if (node.parent) {
-                    node.parent->setChild(getChildDirection(&node), nullptr);
-                } else {
-                    delete self().root;
-                    self().root = nullptr;
-                }
-            } else if (node.childCount() == 1) {
-                if (node.parent) {
-                    node.parent->setChild(getChildDirection(&node), std::move(node.getAnyChild()));
+            if (with)
+                with->parent = parent;
+            if (parent) {
+                (*parent).*(BinaryNode<T_Node>::directionToMember(getChildDirection(&node))) = with;
+            } else {
+                self().root = with;
+            }
+        }
+
+    public:
+        // Only node is freed, with two children its successor is relinked into its place, so no value is copied and
+        // pointers to all other nodes stay valid.
+        void remove(T_Node &node) {
+            // lowest node whose subtree changed
+            T_Node *changed;
+            if (node.childCount() == 2) {
+                T_Node *successor = node.right;
+                while (successor->left)
+                    successor = successor->left;
+                if (successor == node.right) {
+                    changed = successor;
                 } else {
-                    auto save = self().root;
-                    self().root = std::move(node.getAnyChild());
-                    self().root->parent = nullptr;
-                    save->left = save->right = nullptr;
-                    delete save;
+                    changed = successor->parent;
+                    changed->left = successor->right;
+                    if (successor->right)
+                        successor->right->parent = changed;
+                    successor->right = node.right;
+                    node.right->parent = successor;
                 }
-            } else if (node.childCount() == 2) {
-                T_Node *toReplace = node.right;
-                while (toReplace->left)
-                    toReplace = toReplace->left;
-                copyAll(node, *toReplace);
-                remove(*toReplace);
+                successor->left = node.left;
+                node.left->parent = successor;
+                _replace(node, successor);
+            } else {
+                changed = node.parent;
+                _replace(node, node.getAnyChild());
+            }
+            node.left = node.right = nullptr;
+            self().destroyNode(&node);
+
+            if (!changed)
                 return;
+            // Links were set directly, so eager nodes did not bubbleUp on their own either.
+            if constexpr (requires { requires mixins::Mixin<T_Tree, Balancer>; } ||
+                          mixins::Mixin<T_Node, DeferredUpdate>) {
+                updateUp(self(), changed);
+            } else {
+                changed->bubbleUp();
             }
+        }
+    };
 
-            if constexpr (requires { requires mixins::Mixin<T_Tree, Balancer>; }) {
-                if (parent) {
-                    self().balanceUp(parent);
-                }
+    template<typename T_Tree>
+    struct SetValue : mixins::SureIAmThat<T_Tree, SetValue> {
+        using mixins::SureIAmThat<T_Tree, SetValue>::self;
+
+        // Value change of a node already in the tree, refreshes the counters of its ancestors exactly once.
+        T_Node &setValue(T_Node &node, std::decay_t<decltype(std::declval<T_Node>().getValue())> value) {
+            node.setValue(std::move(value));
+            if constexpr (mixins::Mixin<T_Node, DeferredUpdate>) {
+                node.bubbleUp();
             }
+            return node;
         }
     };
 
 
+    template<typename T_Tree>
+    struct Build : mixins::SureIAmThat<T_Tree, Build> {
+        using mixins::SureIAmThat<T_Tree, Build>::self;
+
+    private:
+        template<typename Fill>
+        T_Node *_build(size_t count, T_Node *parent, Fill &fill) {
+            if (count == 0)
+                return nullptr;
+            auto *node = self().createNode();
+            node->parent = parent;
+            node->left = _build(count / 2, node, fill);
+            fill(node->getValue());
+            node->right = _build(count - count / 2 - 1, node, fill);
+            updateAll(*node);
+            return node;
+        }
+
+    public:
+        // Detached, perfectly balanced subtree of count nodes, fill(value) is called on them in order. Every node is
+        // updated exactly once, after its children, so the whole build is O(count). The nodes come from this tree's
+        // allocator, so they have to end up in this tree.
+        template<typename Fill>
+        T_Node *buildNodes(size_t count, Fill &&fill) {
+            return _build(count, nullptr, fill);
+        }
+
+        // Replaces the content by count nodes built by buildNodes.
+        template<typename Fill>
+        void build(size_t count, Fill &&fill) {
+            self().clear();
+            self().root = _build(count, nullptr, fill);
+        }
+    };
+
+    // AVL split and join on detached subtrees, the tree root is not touched so callers can cut the tree into pieces
+    // and put them back together with a single rebalance along the seams. Parents of returned roots are nullptr.
+    template<typename T_Tree>
+    struct SplitJoin : mixins::SureIAmThat<T_Tree, SplitJoin> {
+        using mixins::SureIAmThat<T_Tree, SplitJoin>::self;
+
+    private:
+        static size_t _height(const T_Node *node) {
+            return node ? node->maxDepth : 0;
+        }
+
+        static T_Node *_link(T_Node *node, T_Node *left, T_Node *right) {
+            node->left = left;
+            node->right = right;
+            if (left)
+                left->parent = node;
+            if (right)
+                right->parent = node;
+            updateAll(*node);
+            return node;
+        }
+
+        static T_Node *_rotateLeft(T_Node *node) {
+            pushAll(*node);
+            T_Node *child = node->right;
+            pushAll(*child);
+            _link(node, node->left, child->left);
+            return _link(child, node, child->right);
+        }
+
+        static T_Node *_rotateRight(T_Node *node) {
+            pushAll(*node);
+            T_Node *child = node->left;
+            pushAll(*child);
+            _link(node, child->right, node->right);
+            return _link(child, child->left, node);
+        }
+
+        // node has up to date children which are balanced and differ in height by at most 2
+        static T_Node *_balance(T_Node *node) {
+            int delta = node->getDelta();
+            if (delta > 1) {
+                if (node->left->getSign() < 0)
+                    _link(node, _rotateLeft(node->left), node->right);
+                return _rotateRight(node);
+            }
+            if (delta < -1) {
+                if (node->right->getSign() > 0)
+                    _link(node, node->left, _rotateRight(node->right));
+                return _rotateLeft(node);
+            }
+            return node;
+        }
+
+        static T_Node *_join(T_Node *left, T_Node *mid, T_Node *right) {
+            if (_height(left) > _height(right) + 1) {
+                pushAll(*left);
+                return _balance(_link(left, left->left, _join(left->right, mid, right)));
+            }
+            if (_height(right) > _height(left) + 1) {
+                pushAll(*right);
+                return _balance(_link(right, _join(left, mid, right->left), right->right));
+            }
+            return _link(mid, left, right);
+        }
+
+        static std::pair<T_Node *, T_Node *> _removeLast(T_Node *node) {
+            pushAll(*node);
+            if (!node->right) {
+                T_Node *left = node->left;
+                node->left = nullptr;
+                return {left, node};
+            }
+            auto [rest, last] = _removeLast(node->right);
+            return {_balance(_link(node, node->left, rest)), last};
+        }
+
+        template<auto size_counter>
+        static std::pair<T_Node *, T_Node *> _split(T_Node *node, size_t index) {
+            if (!node)
+                return {nullptr, nullptr};
+            pushAll(*node);
+            size_t left = node->left ? (*node->left).*size_counter : 0;
+            if (index <= left) {
+                auto [first, second] = _split<size_counter>(node->left, index);
+                return {first, _join(second, node, node->right)};
+            }
+            size_t own = node->*size_counter - left - (node->right ? (*node->right).*size_counter : 0);
+            auto [first, second] = _split<size_counter>(node->right, index - left - own);
+            return {_join(node->left, node, first), second};
+        }
+
+        static T_Node *_root(T_Node *node) {
+            if (node)
+                node->parent = nullptr;
+            return node;
+        }
+
+    public:
+        // All of left, then mid, then all of right.
+        static T_Node *join(T_Node *left, T_Node *mid, T_Node *right) {
+            return _root(_join(left, mid, right));
+        }
+
+        static T_Node *join(T_Node *left, T_Node *right) {
+            if (!left)
+                return _root(right);
+            if (!right)
+                return _root(left);
+            auto [rest, last] = _removeLast(left);
+            return join(rest, last, right);
+        }
+
+        // The first index units of size_counter go to the first tree, index has to fall on a node boundary.
+        template<auto size_counter = default_size_counter>
+        static std::pair<T_Node *, T_Node *> split(T_Node *node, size_t index) {
+            auto [first, second] = _split<size_counter>(node, index);
+            return {_root(first), _root(second)};
+        }
+
+        // Everything from index on moves to rest, which is emptied first. O(log n).
+        template<auto size_counter = default_size_counter>
+        void splitAt(size_t index, T_Tree &rest) {
+            rest.clear();
+            self().shareAllocator(rest);
+            auto [first, second] = split<size_counter>(self().root, index);
+            self().root = first;
+            rest.root = second;
+        }
+
+        // Appends all of other and leaves it empty. O(log n).
+        void concat(T_Tree &other) {
+            self().shareAllocator(other);
+            self().root = join(self().root, other.root);
+            other.root = nullptr;
+        }
+
+        // Moves the count units at from so they start at to in the sequence without them. O(log n).
+        template<auto size_counter = default_size_counter>
+        void splice(size_t from, size_t count, size_t to) {
+            auto [before, rest] = split<size_counter>(self().root, from);
+            auto [block, after] = split<size_counter>(rest, count);
+            auto [head, tail] = split<size_counter>(join(before, after), to);
+            self().root = join(join(head, block), tail);
+        }
+    };
+
     template<typename T_Tree>
     struct Size : mixins::SureIAmThat<T_Tree, Size> {
         using mixins::SureIAmThat<T_Tree, Size>::self;
@@ -960,6 +1613,264 @@ struct TreeMixer {
         }
     };
 
+    // Random access iterators over the values in order. Stepping follows InOrder parent pointers, so a whole scan is
+    // O(n), jumps and comparisons go through the node index and cost O(log n).
+    template<typename T_Tree>
+    struct Iterable : mixins::SureIAmThat<T_Tree, Iterable> {
+        using mixins::SureIAmThat<T_Tree, Iterable>::self;
+        using Value = std::decay_t<decltype(std::declval<T_Node>().getValue())>;
+
+        template<bool Const>
+        class Iterator {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = Value;
+            using difference_type = std::ptrdiff_t;
+            using pointer = std::conditional_t<Const, const Value, Value> *;
+            using reference = std::conditional_t<Const, const Value, Value> &;
+            using tree_type = std::conditional_t<Const, const T_Tree, T_Tree>;
+            using node_type = std::conditional_t<Const, const T_Node, T_Node>;
+
+            Iterator() = default;
+
+            Iterator(tree_type *tree, node_type *node) : _tree(tree), _node(node) {}
+
+            operator Iterator<true>() const requires (!Const) {
+                return {_tree, _node};
+            }
+
+            reference operator*() const {
+                return _node->getValue();
+            }
+
+            pointer operator->() const {
+                return &_node->getValue();
+            }
+
+            reference operator[](difference_type n) const {
+                return *(*this + n);
+            }
+
+            Iterator &operator++() {
+                _node = _node->next();
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                Iterator copy = *this;
+                ++*this;
+                return copy;
+            }
+
+            // end() steps back to the last node
+            Iterator &operator--() {
+                if (_node) {
+                    _node = _node->prev();
+                } else {
+                    _node = _tree->root;
+                    while (_node->right)
+                        _node = _node->right;
+                }
+                return *this;
+            }
+
+            Iterator operator--(int) {
+                Iterator copy = *this;
+                --*this;
+                return copy;
+            }
+
+            Iterator &operator+=(difference_type n) {
+                size_t index = _index() + n;
+                _node = index == _tree->getSize() ? nullptr : &_tree->find(index);
+                return *this;
+            }
+
+            Iterator &operator-=(difference_type n) {
+                return *this += -n;
+            }
+
+            Iterator operator+(difference_type n) const {
+                Iterator copy = *this;
+                return copy += n;
+            }
+
+            friend Iterator operator+(difference_type n, const Iterator &it) {
+                return it + n;
+            }
+
+            Iterator operator-(difference_type n) const {
+                Iterator copy = *this;
+                return copy -= n;
+            }
+
+            difference_type operator-(const Iterator &other) const {
+                return difference_type(_index()) - difference_type(other._index());
+            }
+
+            bool operator==(const Iterator &other) const {
+                return _node == other._node;
+            }
+
+            bool operator<(const Iterator &other) const {
+                return _index() < other._index();
+            }
+
+            bool operator>(const Iterator &other) const {
+                return other < *this;
+            }
+
+            bool operator<=(const Iterator &other) const {
+                return !(other < *this);
+            }
+
+            bool operator>=(const Iterator &other) const {
+                return !(*this < other);
+            }
+
+        private:
+            size_t _index() const {
+                return _node ? _node->getOffset() : _tree->getSize();
+            }
+
+            tree_type *_tree = nullptr;
+            node_type *_node = nullptr;
+        };
+
+        using iterator = Iterator<false>;
+        using const_iterator = Iterator<true>;
+
+        iterator begin() {
+            return {&self(), _first(self().root)};
+        }
+
+        iterator end() {
+            return {&self(), nullptr};
+        }
+
+        const_iterator begin() const {
+            return {&self(), _first(self().root)};
+        }
+
+        const_iterator end() const {
+            return {&self(), nullptr};
+        }
+
+    private:
+        template<typename Node>
+        static Node *_first(Node *node) {
+            if (node)
+                while (node->left)
+                    node = node->left;
+            return node;
+        }
+    };
+
+    // Sequence with range updates and range queries on LazyUpdate nodes, O(log n) each. The range is split out,
+    // tagged or read at its root and joined back, inserting and erasing go through split and join as well. Values
+    // below a pending tag are stale, read single values with get.
+    template<typename T_Tree>
+    struct RangeUpdate : mixins::SureIAmThat<T_Tree, RangeUpdate> {
+        using mixins::SureIAmThat<T_Tree, RangeUpdate>::self;
+        using Value = std::decay_t<decltype(std::declval<T_Node>().getValue())>;
+        using Tag = RangeTag<Value>;
+
+    private:
+        void _check(size_t from, size_t count) const {
+            size_t size = self().getSize();
+            if (from > size || count > size - from)
+                throw std::out_of_range("Range " + std::to_string(from) + "+" + std::to_string(count) +
+                                        " out of range, size is " + std::to_string(size));
+        }
+
+        // Runs fun on the root of [from, from + count) cut out of the tree (nullptr when empty).
+        template<typename Fun>
+        auto _onRange(size_t from, size_t count, Fun &&fun) {
+            _check(from, count);
+            auto [before, rest] = self().split(self().root, from);
+            auto [range, after] = self().split(rest, count);
+            auto rejoin = [&, before = before, after = after]() {
+                self().root = self().join(self().join(before, range), after);
+            };
+            if constexpr (std::is_void_v<decltype(fun(range))>) {
+                fun(range);
+                rejoin();
+            } else {
+                auto result = fun(range);
+                rejoin();
+                return result;
+            }
+        }
+
+    public:
+        void add(size_t from, size_t count, Value delta) {
+            _onRange(from, count, [&](T_Node *range) {
+                if (range)
+                    range->apply(Tag{.add = delta});
+            });
+        }
+
+        void assign(size_t from, size_t count, Value value) {
+            _onRange(from, count, [&](T_Node *range) {
+                if (range)
+                    range->apply(Tag{.assigned = value, .assign = true});
+            });
+        }
+
+        void reverse(size_t from, size_t count) {
+            _onRange(from, count, [&](T_Node *range) {
+                if (range)
+                    range->apply(Tag{.reverse = true});
+            });
+        }
+
+        Value sum(size_t from, size_t count) {
+            return _onRange(from, count, [&](T_Node *range) { return range ? range->sum : Value{}; });
+        }
+
+        Value min(size_t from, size_t count) {
+            if (count == 0)
+                throw std::out_of_range("Minimum of an empty range");
+            return _onRange(from, count, [&](T_Node *range) { return range->minimum; });
+        }
+
+        // Pushes the pending tags on the path down, so the value is current.
+        const Value &get(size_t index) {
+            _check(index, 1);
+            T_Node *node = self().root;
+            while (true) {
+                pushAll(*node);
+                size_t left = node->left ? (*node->left).*default_size_counter : 0;
+                if (index == left)
+                    return node->getValue();
+                if (index < left) {
+                    node = node->left;
+                } else {
+                    index -= left + 1;
+                    node = node->right;
+                }
+            }
+        }
+
+        void insert(size_t index, Value value) {
+            _check(index, 0);
+            T_Node *node = self().createNode();
+            node->setValue(std::move(value));
+            auto [before, after] = self().split(self().root, index);
+            self().root = self().join(before, node, after);
+        }
+
+        Value erase(size_t index) {
+            _check(index, 1);
+            auto [before, rest] = self().split(self().root, index);
+            auto [node, after] = self().split(rest, 1);
+            Value value = std::move(node->getValue());
+            self().destroyNode(node);
+            self().root = self().join(before, after);
+            return value;
+        }
+    };
+
 };
 
 
@@ -973,7 +1884,9 @@ using AugmentedNode = mixins::Mixins<
         ParentNode,
         GetIndex,
         BubbleUp,
+        DeferredUpdate,
         BinaryNode,
+        InOrder,
         GraphViz,
         MaxDepth,
         NewLineCounter,
@@ -988,6 +1901,7 @@ using AVLNode = mixins::Mixins<
         ValueNode<ValueType>::template Inner,
         ParentNode,
         BubbleUp,
+        DeferredUpdate,
         BinaryNode,
         GraphViz,
         SizeCounter,
@@ -995,16 +1909,40 @@ using AVLNode = mixins::Mixins<
         Equals,
         Comparable<ValueType>::template Inner>;
 
+// Value, three links, two counters and the depth byte. Mixins lays the fields out by alignment, so the char value and
+// the depth share the padded tail instead of each taking a word.
+static_assert(sizeof(void *) != 8 || sizeof(AugmentedNode<char>) == 48, "AugmentedNode<char> grew");
+static_assert(sizeof(void *) != 8 || sizeof(AVLNode<char>) == 40, "AVLNode<char> grew");
+
+// Sequence of numbers with range add/assign/reverse and range sum/min.
+template<typename Value = long long>
+using LazyNode = mixins::Mixins<
+        ValueNode<Value>::template Inner,
+        ParentNode,
+        BubbleUp,
+        DeferredUpdate,
+        BinaryNode,
+        MaxDepth,
+        SizeCounter,
+        RangeAggregate<Value>::template Inner,
+        LazyUpdate<Value>::template Inner,
+        Equals>;
+
 template<typename T_Node>
 constexpr auto NewLineCounterSize = &NewLineCounter<T_Node>::size;
 
 template<typename Value = char>
 using AugmentedAVLTree = mixins::Mixins<
         TreeMixer<AugmentedNode<Value>>::template Inner,
+        TreeMixer<AugmentedNode<Value>>::template Arena,
         TreeMixer<AugmentedNode<Value>>::template Indexable,
         TreeMixer<AugmentedNode<Value>>::template InsertAt,
         TreeMixer<AugmentedNode<Value>>::template Delete,
+        TreeMixer<AugmentedNode<Value>>::template SetValue,
+        TreeMixer<AugmentedNode<Value>>::template Build,
+        TreeMixer<AugmentedNode<Value>>::template SplitJoin,
         TreeMixer<AugmentedNode<Value>>::template Size,
+        TreeMixer<AugmentedNode<Value>>::template Iterable,
         TreeMixer<AugmentedNode<Value>>::template Rotator,
         TreeMixer<AugmentedNode<Value>>::template Balancer
 >;
@@ -1012,6 +1950,7 @@ using AugmentedAVLTree = mixins::Mixins<
 template<typename Value = char>
 using AVLTree = mixins::Mixins<
         TreeMixer<AVLNode<Value>>::template Inner,
+        TreeMixer<AVLNode<Value>>::template Arena,
         TreeMixer<AVLNode<Value>>::template Delete,
         TreeMixer<AVLNode<Value>>::template Rotator,
         TreeMixer<AVLNode<Value>>::template Balancer,
@@ -1020,7 +1959,343 @@ using AVLTree = mixins::Mixins<
         TreeMixer<AVLNode<Value>>::template Size
 >;
 
+template<typename Value = long long>
+using LazyAVLTree = mixins::Mixins<
+        TreeMixer<LazyNode<Value>>::template Inner,
+        TreeMixer<LazyNode<Value>>::template Arena,
+        TreeMixer<LazyNode<Value>>::template Build,
+        TreeMixer<LazyNode<Value>>::template SplitJoin,
+        TreeMixer<LazyNode<Value>>::template Size,
+        TreeMixer<LazyNode<Value>>::template RangeUpdate
+>;
+
 template<typename T_Tree>
 constexpr auto AVLTreeNewLineCounterSize = &NewLineCounter<typename T_Tree::NodeType>::size;
 
+// region rope
+
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Byte classes counted by the rope. test(char) is the scalar check, the vector overloads return 0xff in every
+// matching lane so that counting and searching go 32 (AVX2) or 16 (SSE2) bytes per compare.
+template<char byte>
+struct ByteEquals {
+    static bool test(char c) {
+        return c == byte;
+    }
+
+#ifdef __SSE2__
+
+    static __m128i test(__m128i block) {
+        return _mm_cmpeq_epi8(block, _mm_set1_epi8(byte));
+    }
+
+#endif
+#ifdef __AVX2__
+
+    static __m256i test(__m256i block) {
+        return _mm256_cmpeq_epi8(block, _mm256_set1_epi8(byte));
+    }
+
+#endif
+};
+
+using IsNewLine = ByteEquals<'\n'>;
+using IsTab = ByteEquals<'\t'>;
+
+// First byte of a UTF-8 code point, anything but a 10xxxxxx continuation byte (-128..-65 as a signed char).
+struct IsUtf8Lead {
+    static bool test(char c) {
+        return (c & 0xC0) != 0x80;
+    }
+
+#ifdef __SSE2__
+
+    static __m128i test(__m128i block) {
+        return _mm_cmpgt_epi8(block, _mm_set1_epi8(-65));
+    }
+
+#endif
+#ifdef __AVX2__
+
+    static __m256i test(__m256i block) {
+        return _mm256_cmpgt_epi8(block, _mm256_set1_epi8(-65));
+    }
+
+#endif
+};
+
+namespace detail {
+    // Bytes in [data, data + size) matching Predicate, compare and popcount per block, scalar for the tail.
+    template<typename Predicate>
+    size_t countIf(const char *data, size_t size) {
+        size_t count = 0, i = 0;
+#ifdef __AVX2__
+        for (; i + 32 <= size; i += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            count += __builtin_popcount(unsigned(_mm256_movemask_epi8(Predicate::test(block))));
+        }
+#endif
+#ifdef __SSE2__
+        for (; i + 16 <= size; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            count += __builtin_popcount(unsigned(_mm_movemask_epi8(Predicate::test(block))));
+        }
+#endif
+        for (; i < size; ++i)
+            count += Predicate::test(data[i]);
+        return count;
+    }
+
+    // Position of the matching byte with the given index (0 based), size if there are not that many.
+    template<typename Predicate>
+    size_t findNthIf(const char *data, size_t size, size_t index) {
+        size_t i = 0;
+#ifdef __AVX2__
+        for (; i + 32 <= size; i += 32) {
+            __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            auto mask = unsigned(_mm256_movemask_epi8(Predicate::test(block)));
+            size_t count = __builtin_popcount(mask);
+            if (index < count) {
+                for (; index; --index)
+                    mask &= mask - 1;
+                return i + __builtin_ctz(mask);
+            }
+            index -= count;
+        }
+#endif
+#ifdef __SSE2__
+        for (; i + 16 <= size; i += 16) {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            auto mask = unsigned(_mm_movemask_epi8(Predicate::test(block)));
+            size_t count = __builtin_popcount(mask);
+            if (index < count) {
+                for (; index; --index)
+                    mask &= mask - 1;
+                return i + __builtin_ctz(mask);
+            }
+            index -= count;
+        }
+#endif
+        for (; i < size; ++i) {
+            if (Predicate::test(data[i]) && index-- == 0)
+                return i;
+        }
+        return size;
+    }
+}
+
+// Fixed capacity piece of text stored inline in a rope node, caches how many of its bytes match each of Counted.
+template<size_t Capacity, typename... Counted>
+struct BasicTextChunk {
+    static_assert(Capacity > 1 && Capacity <= std::numeric_limits<uint16_t>::max(), "Unsupported chunk capacity");
+    static constexpr size_t capacity = Capacity;
+
+    template<typename Predicate>
+    static constexpr bool counts = (std::is_same_v<Predicate, Counted> || ...);
+
+    size_t size() const {
+        return _size;
+    }
+
+    template<typename Predicate>
+    size_t count() const {
+        return _counts[_slot<Predicate>()];
+    }
+
+    size_t newLines() const {
+        return count<IsNewLine>();
+    }
+
+    bool full() const {
+        return _size == Capacity;
+    }
+
+    const char *data() const {
+        return _data;
+    }
+
+    char operator[](size_t index) const {
+        return _data[index];
+    }
+
+    // Returns whether any of the cached counts changed.
+    bool set(size_t index, char c) {
+        bool changed = false;
+        size_t slot = 0;
+        ((changed |= _adjust(slot++, int(Counted::test(c)) - int(Counted::test(_data[index])))), ...);
+        _data[index] = c;
+        return changed;
+    }
+
+    void insert(size_t index, char c) {
+        std::memmove(_data + index + 1, _data + index, _size - index);
+        _data[index] = c;
+        _size++;
+        size_t slot = 0;
+        ((_counts[slot++] += Counted::test(c)), ...);
+    }
+
+    void insert(size_t index, const char *text, size_t count) {
+        std::memmove(_data + index + count, _data + index, _size - index);
+        std::memcpy(_data + index, text, count);
+        _size += count;
+        _countIn(text, count);
+    }
+
+    void erase(size_t index) {
+        size_t slot = 0;
+        ((_counts[slot++] -= Counted::test(_data[index])), ...);
+        std::memmove(_data + index, _data + index + 1, _size - index - 1);
+        _size--;
+    }
+
+    void erase(size_t index, size_t count) {
+        size_t slot = 0;
+        ((_counts[slot++] -= detail::countIf<Counted>(_data + index, count)), ...);
+        std::memmove(_data + index, _data + index + count, _size - index - count);
+        _size -= count;
+    }
+
+    void append(const char *text, size_t count) {
+        std::memcpy(_data + _size, text, count);
+        _size += count;
+        _countIn(text, count);
+    }
+
+    void append(const BasicTextChunk &other) {
+        append(other._data, other._size);
+    }
+
+    // Moves [index, size) out into a new chunk.
+    BasicTextChunk splitOff(size_t index) {
+        BasicTextChunk tail;
+        tail.append(_data + index, _size - index);
+        for (size_t slot = 0; slot < sizeof...(Counted); ++slot)
+            _counts[slot] -= tail._counts[slot];
+        _size = index;
+        return tail;
+    }
+
+    // Bytes matching Predicate in [0, end).
+    template<typename Predicate>
+    size_t countBefore(size_t end) const {
+        return detail::countIf<Predicate>(_data, end);
+    }
+
+    // Position of the matching byte with the given index (0 based) inside this chunk.
+    template<typename Predicate>
+    size_t find(size_t index) const {
+        return detail::findNthIf<Predicate>(_data, _size, index);
+    }
+
+    size_t countNewLines(size_t end) const {
+        return countBefore<IsNewLine>(end);
+    }
+
+    size_t findNewLine(size_t index) const {
+        return find<IsNewLine>(index);
+    }
+
+private:
+    template<typename Predicate>
+    static constexpr size_t _slot() {
+        static_assert(counts<Predicate>, "Predicate is not counted by this chunk");
+        constexpr bool matches[] = {std::is_same_v<Predicate, Counted>...};
+        size_t slot = 0;
+        while (!matches[slot])
+            slot++;
+        return slot;
+    }
+
+    bool _adjust(size_t slot, int delta) {
+        _counts[slot] += delta;
+        return delta != 0;
+    }
+
+    void _countIn(const char *text, size_t count) {
+        size_t slot = 0;
+        ((_counts[slot++] += detail::countIf<Counted>(text, count)), ...);
+    }
+
+    uint16_t _size = 0;
+    std::array<uint16_t, sizeof...(Counted)> _counts = {};
+    char _data[Capacity];
+};
+
+template<size_t Capacity>
+using TextChunk = BasicTextChunk<Capacity, IsNewLine>;
+
+// Chunked text tree, nodes sum characters, newlines and the bytes matching each of Counted over their subtree.
+template<size_t Capacity, typename... Counted>
+struct Rope {
+    using Chunk = BasicTextChunk<Capacity, IsNewLine, Counted...>;
+
+    template<typename T_Node>
+    using CharCounter = typename WeightedSizeCounter<&Chunk::size>::template Inner<T_Node>;
+
+    template<typename Predicate>
+    struct ChunkCounter {
+        template<typename T_Node>
+        using Inner = typename WeightedSizeCounter<&Chunk::template count<Predicate>>::template Inner<T_Node>;
+    };
+
+    using Node = mixins::Mixins<
+            ValueNode<Chunk>::template Inner,
+            ParentNode,
+            GetIndex,
+            BubbleUp,
+            DeferredUpdate,
+            BinaryNode,
+            InOrder,
+            MaxDepth,
+            CharCounter,
+            ChunkCounter<IsNewLine>::template Inner,
+            ChunkCounter<Counted>::template Inner...,
+            SizeCounter,
+            Indexable,
+            InsertAt,
+            Equals>;
+
+    using Tree = mixins::Mixins<
+            TreeMixer<Node>::template Inner,
+            TreeMixer<Node>::template Arena,
+            TreeMixer<Node>::template Indexable,
+            TreeMixer<Node>::template InsertAt,
+            TreeMixer<Node>::template Delete,
+            TreeMixer<Node>::template SetValue,
+            TreeMixer<Node>::template Build,
+            TreeMixer<Node>::template SplitJoin,
+            TreeMixer<Node>::template Size,
+            TreeMixer<Node>::template Rotator,
+            TreeMixer<Node>::template Balancer
+    >;
+
+    static constexpr auto CharSize = &CharCounter<Node>::size;
+
+    template<typename Predicate>
+    static constexpr auto CountSize = &ChunkCounter<Predicate>::template Inner<Node>::size;
+
+    static constexpr auto NewLineSize = CountSize<IsNewLine>;
+
+    // Adds c to the counters of node and of all its ancestors, or takes it away, after c was typed into or erased
+    // from the chunk of node. Nothing else in the chunk changed, so one add per counter and level is enough where
+    // bubbleUp would sum every counter of both children again.
+    static void countChar(Node &node, char c, bool added) {
+        std::ptrdiff_t delta = added ? 1 : -1;
+        std::ptrdiff_t newLine = IsNewLine::test(c) ? delta : 0;
+        for (Node *current = &node; current; current = current->parent) {
+            current->*CharSize += delta;
+            current->*NewLineSize += newLine;
+            ((current->*CountSize<Counted> += Counted::test(c) ? delta : 0), ...);
+        }
+    }
+};
+
+// endregion
+
 //endregion
\ No newline at end of file
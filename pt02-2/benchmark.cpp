@@ -0,0 +1,309 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <tuple>
+#include <span>
+#include <vector>
+
+#include "main.cpp"
+#include "counted_btree.hpp"
+
+// Appending is the TextEditorBackend constructor pattern, every insert walks the right spine and rebalances.
+static void augmented_insert_back(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    for (auto _: state) {
+        AugmentedAVLTree<> tree;
+        for (size_t i = 0; i < count; ++i) {
+            tree.insert(tree.getSize(), char(i % 10 ? 'a' + i % 26 : '\n'));
+        }
+        benchmark::DoNotOptimize(tree.root);
+    }
+    state.SetItemsProcessed((int64_t) (state.iterations() * count));
+}
+
+static void augmented_insert_random(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    for (auto _: state) {
+        std::mt19937 rng(12345);
+        AugmentedAVLTree<> tree;
+        for (size_t i = 0; i < count; ++i) {
+            tree.insert(rng() % (tree.getSize() + 1), char(i % 10 ? 'a' + i % 26 : '\n'));
+        }
+        benchmark::DoNotOptimize(tree.root);
+    }
+    state.SetItemsProcessed((int64_t) (state.iterations() * count));
+}
+
+// The same on the counted B+-tree, side by side with the AVL mixers above and below.
+using btree_t = CountedBTree<char>;
+
+static void btree_insert_back(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    for (auto _: state) {
+        btree_t tree;
+        for (size_t i = 0; i < count; ++i) {
+            tree.insert(tree.getSize(), char(i % 10 ? 'a' + i % 26 : '\n'));
+        }
+        benchmark::DoNotOptimize(tree.getSize());
+    }
+    state.SetItemsProcessed((int64_t) (state.iterations() * count));
+}
+
+static void btree_insert_random(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    for (auto _: state) {
+        std::mt19937 rng(12345);
+        btree_t tree;
+        for (size_t i = 0; i < count; ++i) {
+            tree.insert(rng() % (tree.getSize() + 1), char(i % 10 ? 'a' + i % 26 : '\n'));
+        }
+        benchmark::DoNotOptimize(tree.getSize());
+    }
+    state.SetItemsProcessed((int64_t) (state.iterations() * count));
+}
+
+static void btree_remove_random(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    for (auto _: state) {
+        state.PauseTiming();
+        btree_t tree;
+        for (size_t i = 0; i < count; ++i) tree.insert(i, 'a');
+        std::mt19937 rng(12345);
+        state.ResumeTiming();
+        while (tree.getSize()) tree.remove(rng() % tree.getSize());
+    }
+    state.SetItemsProcessed((int64_t) (state.iterations() * count));
+}
+
+static void augmented_remove_random(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    for (auto _: state) {
+        state.PauseTiming();
+        AugmentedAVLTree<> tree;
+        tree.build(count, [](char &c) { c = 'a'; });
+        std::mt19937 rng(12345);
+        state.ResumeTiming();
+        while (tree.getSize()) tree.remove(tree.find(rng() % tree.getSize()));
+    }
+    state.SetItemsProcessed((int64_t) (state.iterations() * count));
+}
+
+static btree_t &char_btree(size_t count) {
+    static std::unique_ptr<btree_t> tree;
+    if (!tree || tree->getSize() != count) {
+        tree = nullptr;
+        tree = std::make_unique<btree_t>();
+        for (size_t i = 0; i < count; ++i) tree->insert(i, i % 10 ? 'a' : '\n');
+    }
+    return *tree;
+}
+
+static void btree_find_index(benchmark::State &state) {
+    auto &tree = char_btree((size_t) state.range(0));
+    std::mt19937 rng(12345);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(&tree.find(rng() % tree.getSize()));
+    }
+}
+
+// Random access into a node-per-character tree by position and by newline, range(0) nodes, every 10th is '\n'.
+using char_tree_t = AugmentedAVLTree<>;
+
+static char_tree_t &char_tree(size_t count) {
+    static std::unique_ptr<char_tree_t> tree;
+    if (!tree || tree->getSize() != count) {
+        tree = nullptr;
+        tree = std::make_unique<char_tree_t>();
+        size_t i = 0;
+        tree->build(count, [&i](char &c) { c = i++ % 10 ? 'a' : '\n'; });
+    }
+    return *tree;
+}
+
+static void augmented_find_index(benchmark::State &state) {
+    auto &tree = char_tree((size_t) state.range(0));
+    std::mt19937 rng(12345);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(&tree.find(rng() % tree.getSize()));
+    }
+}
+
+static void augmented_find_newline(benchmark::State &state) {
+    auto &tree = char_tree((size_t) state.range(0));
+    constexpr auto newLines = AVLTreeNewLineCounterSize<char_tree_t>;
+    std::mt19937 rng(12345);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(&tree.find<newLines>(rng() % tree.getSize<newLines>()));
+    }
+}
+
+// Pasting a block into the middle of a 1 MB text, one character at a time and as a single range.
+static std::string paste_text(size_t count) {
+    std::string text(count, 'a');
+    for (size_t i = 0; i < count; i += 60) text[i] = '\n';
+    return text;
+}
+
+static void text_paste_chars(benchmark::State &state) {
+    std::string block = paste_text((size_t) state.range(0));
+    for (auto _: state) {
+        state.PauseTiming();
+        TextEditorBackend text(paste_text(1 << 20));
+        state.ResumeTiming();
+        size_t position = text.size() / 2;
+        for (char c: block) text.insert(position++, c);
+        benchmark::DoNotOptimize(text.tree.root);
+    }
+    state.SetBytesProcessed((int64_t) (state.iterations() * block.size()));
+}
+
+static void text_paste_range(benchmark::State &state) {
+    std::string block = paste_text((size_t) state.range(0));
+    for (auto _: state) {
+        state.PauseTiming();
+        TextEditorBackend text(paste_text(1 << 20));
+        state.ResumeTiming();
+        text.insert(text.size() / 2, block);
+        benchmark::DoNotOptimize(text.tree.root);
+    }
+    state.SetBytesProcessed((int64_t) (state.iterations() * block.size()));
+}
+
+// Typing range(0) characters into the middle of 16 MB of text, every keystroke by index and through a cursor.
+static void text_type_index(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    for (auto _: state) {
+        state.PauseTiming();
+        TextEditorBackend text(paste_text(16 << 20));
+        state.ResumeTiming();
+        size_t position = text.size() / 2;
+        for (size_t i = 0; i < count; ++i) {
+            text.insert(position++, char('a' + i % 26));
+            if (i % 7 == 6) text.erase(--position);
+        }
+        benchmark::DoNotOptimize(text.size());
+    }
+    state.SetItemsProcessed((int64_t) (state.iterations() * count));
+}
+
+static void text_type_cursor(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    for (auto _: state) {
+        state.PauseTiming();
+        TextEditorBackend text(paste_text(16 << 20));
+        state.ResumeTiming();
+        auto cursor = text.cursor(text.size() / 2);
+        for (size_t i = 0; i < count; ++i) {
+            cursor.insert(char('a' + i % 26));
+            if (i % 7 == 6) cursor.erase_before();
+        }
+        benchmark::DoNotOptimize(text.size());
+    }
+    state.SetItemsProcessed((int64_t) (state.iterations() * count));
+}
+
+// 64 keystrokes typed with range(0) cursors spread over 16 MB of text, an insert per cursor and a batch per keystroke.
+static void text_multicursor_inserts(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    TextEditorBackend text(paste_text(16 << 20));
+    std::vector<size_t> cursors;
+    for (size_t k = 0; k < count; ++k) cursors.push_back(k * (text.size() / count));
+    for (auto _: state) {
+        for (size_t key = 0; key < 64; ++key) {
+            // the k cursors in front of cursor k typed already, then every cursor moves past what was typed
+            for (size_t k = 0; k < count; ++k) text.insert(cursors[k] + k, char('a' + key % 26));
+            for (size_t k = 0; k < count; ++k) cursors[k] += k + 1;
+        }
+        benchmark::DoNotOptimize(text.size());
+    }
+    state.SetItemsProcessed((int64_t) (state.iterations() * 64 * count));
+}
+
+static void text_multicursor_batch(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    TextEditorBackend text(paste_text(16 << 20));
+    std::vector<TextEditorBackend::Edit> edits;
+    for (size_t k = 0; k < count; ++k) edits.push_back({k * (text.size() / count), 0, {}});
+    for (auto _: state) {
+        for (size_t key = 0; key < 64; ++key) {
+            char c = char('a' + key % 26);
+            for (auto &edit: edits) edit.text = std::string_view(&c, 1);
+            text.apply_edits(edits);
+        }
+        benchmark::DoNotOptimize(text.size());
+    }
+    state.SetItemsProcessed((int64_t) (state.iterations() * 64 * count));
+}
+
+// Adding to a random range of range(0) elements out of 1M, element by element and as one lazy range update.
+static void range_add_elements(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    AugmentedAVLTree<long long> tree;
+    tree.build(1 << 20, [](long long &value) { value = 1; });
+    std::mt19937 rng(12345);
+    for (auto _: state) {
+        size_t from = rng() % (tree.getSize() - count + 1);
+        for (auto it = tree.begin() + std::ptrdiff_t(from), end = it + std::ptrdiff_t(count); it != end; ++it) *it += 3;
+        benchmark::DoNotOptimize(tree.root);
+    }
+    state.SetItemsProcessed((int64_t) state.iterations());
+}
+
+static void range_add_lazy(benchmark::State &state) {
+    auto count = (size_t) state.range(0);
+    LazyAVLTree<long long> tree;
+    tree.build(1 << 20, [](long long &value) { value = 1; });
+    std::mt19937 rng(12345);
+    for (auto _: state) {
+        size_t from = rng() % (tree.getSize() - count + 1);
+        tree.add(from, count, 3);
+        benchmark::DoNotOptimize(tree.sum(from, count));
+    }
+    state.SetItemsProcessed((int64_t) state.iterations());
+}
+
+// Random line queries on 16 MB of text, range(0) is the line length, the last case is one minified JSON like line.
+static void text_line_queries(benchmark::State &state) {
+    auto lineLength = (size_t) state.range(0);
+    std::string source(16 << 20, 'a');
+    for (size_t i = lineLength - 1; i < source.size(); i += lineLength) source[i] = '\n';
+    TextEditorBackend text(source);
+    std::mt19937 rng(12345);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(text.char_to_line(rng() % text.size()));
+        benchmark::DoNotOptimize(text.line_start(rng() % text.lines()));
+    }
+    state.SetItemsProcessed((int64_t) state.iterations() * 2);
+}
+
+BENCHMARK(augmented_insert_back)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+BENCHMARK(augmented_insert_random)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+BENCHMARK(augmented_remove_random)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+BENCHMARK(btree_insert_back)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+BENCHMARK(btree_insert_random)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+BENCHMARK(btree_remove_random)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+
+BENCHMARK(text_paste_chars)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+BENCHMARK(text_paste_range)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+
+BENCHMARK(text_type_index)->Arg(1 << 16);
+BENCHMARK(text_type_cursor)->Arg(1 << 16);
+BENCHMARK(text_multicursor_inserts)->Arg(10)->Arg(1000)->Arg(100'000);
+BENCHMARK(text_multicursor_batch)->Arg(10)->Arg(1000)->Arg(100'000);
+
+BENCHMARK(range_add_elements)->RangeMultiplier(16)->Range(1 << 4, 1 << 16);
+BENCHMARK(range_add_lazy)->RangeMultiplier(16)->Range(1 << 4, 1 << 16);
+
+BENCHMARK(text_line_queries)->Arg(80)->Arg(4096)->Arg(16 << 20);
+
+BENCHMARK(augmented_find_index)->Arg(1 << 16)->Arg(10'000'000);
+BENCHMARK(btree_find_index)->Arg(1 << 16)->Arg(10'000'000);
+BENCHMARK(augmented_find_newline)->Arg(1 << 16)->Arg(10'000'000);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,549 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Counted B+-tree, a standalone wide node sequence for long sequences. Values sit in contiguous leaf arrays and
+// internal nodes keep the totals of every counter per child, so a lookup is a few short linear scans over one or two
+// cache lines per level instead of a dependent pointer load per bit of the index.
+//
+// It is not a TreeMixer: there is no node per value for a member pointer counter or remove(node &) to refer to,
+// values move between leaves on every split and merge. Counters are numbered instead, remove takes an index and
+// BTreeArray below gives it the element surface of Array<T>.
+//
+// Counter 0 counts values, every functor in Weights (size_t(const T &)) adds one more counter summed the same way,
+// find<1>(i) is then the value holding the i-th unit of the first weight. Values are only changed through set,
+// so the totals stay right, with no weights find hands out mutable references as well.
+template<typename T, size_t LeafCapacity = 64, size_t Fanout = 32, typename... Weights>
+class CountedBTree {
+    static_assert(LeafCapacity >= 4 && Fanout >= 4, "Nodes have to fit at least 4 entries");
+
+public:
+    static constexpr size_t Counters = 1 + sizeof...(Weights);
+    using Counts = std::array<size_t, Counters>;
+
+    template<typename V>
+    struct ValueOffset {
+        V *value;
+        // units of the counter in front of the searched one inside value
+        size_t offset;
+    };
+
+private:
+    struct Node {
+        bool leaf;
+        // values in a leaf, children in an internal node
+        uint16_t count = 0;
+    };
+
+    // Only the first count slots hold values, T needs no default constructor and freed slots hold nothing.
+    struct Leaf : Node {
+        Leaf() : Node{true} {}
+
+        ~Leaf() {
+            std::destroy_n(values(), this->count);
+        }
+
+        T *values() {
+            return std::launder(reinterpret_cast<T *>(storage));
+        }
+
+        const T *values() const {
+            return std::launder(reinterpret_cast<const T *>(storage));
+        }
+
+        // Moves the values in [index, count) one slot up and constructs value at index.
+        void insertAt(size_t index, T &&value) {
+            T *slots = values();
+            if (index == this->count) {
+                std::construct_at(slots + index, std::move(value));
+            } else {
+                std::construct_at(slots + this->count, std::move(slots[this->count - 1]));
+                std::move_backward(slots + index, slots + this->count - 1, slots + this->count);
+                slots[index] = std::move(value);
+            }
+            this->count++;
+        }
+
+        T removeAt(size_t index) {
+            T *slots = values();
+            T value = std::move(slots[index]);
+            std::move(slots + index + 1, slots + this->count, slots + index);
+            std::destroy_at(slots + --this->count);
+            return value;
+        }
+
+        // Moves the values from index on to the end of other.
+        void moveTo(size_t index, Leaf &other) {
+            std::uninitialized_move(values() + index, values() + this->count, other.values() + other.count);
+            std::destroy(values() + index, values() + this->count);
+            other.count += this->count - index;
+            this->count = uint16_t(index);
+        }
+
+        alignas(T) std::byte storage[sizeof(T) * LeafCapacity];
+    };
+
+    struct Internal : Node {
+        Internal() : Node{false} {}
+
+        Node *children[Fanout];
+        Counts counts[Fanout];
+    };
+
+    // Deep enough for Fanout^MaxDepth values with the minimal Fanout.
+    static constexpr size_t MaxDepth = 32;
+
+    Node *_root = nullptr;
+    Counts _totals{};
+
+    static Counts _weigh(const T &value) {
+        Counts counts{};
+        counts[0] = 1;
+        size_t i = 1;
+        ((counts[i++] = Weights{}(value)), ...);
+        return counts;
+    }
+
+    static void _add(Counts &to, const Counts &counts) {
+        for (size_t i = 0; i < Counters; ++i)
+            to[i] += counts[i];
+    }
+
+    static void _subtract(Counts &from, const Counts &counts) {
+        for (size_t i = 0; i < Counters; ++i)
+            from[i] -= counts[i];
+    }
+
+    static Counts _total(const Node *node) {
+        Counts total{};
+        if (node->leaf) {
+            auto *leaf = static_cast<const Leaf *>(node);
+            if constexpr (Counters == 1) {
+                total[0] = leaf->count;
+            } else {
+                for (size_t i = 0; i < leaf->count; ++i)
+                    _add(total, _weigh(leaf->values()[i]));
+            }
+        } else {
+            auto *internal = static_cast<const Internal *>(node);
+            for (size_t i = 0; i < internal->count; ++i)
+                _add(total, internal->counts[i]);
+        }
+        return total;
+    }
+
+    static void _destroy(Node *node) {
+        if (!node)
+            return;
+        if (node->leaf) {
+            delete static_cast<Leaf *>(node);
+            return;
+        }
+        auto *internal = static_cast<Internal *>(node);
+        for (size_t i = 0; i < internal->count; ++i)
+            _destroy(internal->children[i]);
+        delete internal;
+    }
+
+    void _checkIndex(size_t index, size_t max) const {
+        if (index > max)
+            throw std::out_of_range("Index out of range " + std::to_string(index) + " maximum is " +
+                                    std::to_string(max));
+    }
+
+    // Path of a descent, the child taken at every internal level.
+    struct Path {
+        Internal *nodes[MaxDepth];
+        uint16_t slots[MaxDepth];
+        size_t depth = 0;
+    };
+
+    // Leaf holding the index-th unit of counter, index becomes the value slot and offset the units in front of it
+    // inside that value. With inclusive an index equal to a child total stays in that child (insert at its end).
+    template<size_t counter, bool inclusive = false>
+    Leaf *_descend(size_t &index, size_t &offset, Path *path) const {
+        Node *node = _root;
+        while (!node->leaf) {
+            auto *internal = static_cast<Internal *>(node);
+            size_t i = 0;
+            while (i + 1 < internal->count &&
+                   (inclusive ? index > internal->counts[i][counter] : index >= internal->counts[i][counter])) {
+                index -= internal->counts[i][counter];
+                ++i;
+            }
+            if (path) {
+                path->nodes[path->depth] = internal;
+                path->slots[path->depth++] = uint16_t(i);
+            }
+            node = internal->children[i];
+        }
+        auto *leaf = static_cast<Leaf *>(node);
+        offset = 0;
+        if constexpr (counter != 0) {
+            size_t slot = 0;
+            while (slot + 1 < leaf->count) {
+                size_t weight = _weigh(leaf->values()[slot])[counter];
+                if (index < weight)
+                    break;
+                index -= weight;
+                ++slot;
+            }
+            offset = index;
+            index = slot;
+        }
+        return leaf;
+    }
+
+    // Inserts child (with totals counts) right after slot, splitting the node when it is full. Returns the new right
+    // sibling or nullptr. With append (child goes last) the node stays full and the sibling starts with child alone.
+    static Internal *_insertChild(Internal *node, size_t slot, Node *child, const Counts &counts, bool append) {
+        if (node->count < Fanout) {
+            for (size_t i = node->count; i > slot + 1; --i) {
+                node->children[i] = node->children[i - 1];
+                node->counts[i] = node->counts[i - 1];
+            }
+            node->children[slot + 1] = child;
+            node->counts[slot + 1] = counts;
+            node->count++;
+            return nullptr;
+        }
+        Node *children[Fanout + 1];
+        Counts childCounts[Fanout + 1];
+        for (size_t i = 0, j = 0; i <= Fanout; ++i) {
+            if (i == slot + 1) {
+                children[i] = child;
+                childCounts[i] = counts;
+            } else {
+                children[i] = node->children[j];
+                childCounts[i] = node->counts[j++];
+            }
+        }
+        auto *right = new Internal;
+        size_t half = append ? Fanout : (Fanout + 1) / 2;
+        node->count = uint16_t(half);
+        right->count = uint16_t(Fanout + 1 - half);
+        for (size_t i = 0; i < half; ++i) {
+            node->children[i] = children[i];
+            node->counts[i] = childCounts[i];
+        }
+        for (size_t i = half; i <= Fanout; ++i) {
+            right->children[i - half] = children[i];
+            right->counts[i - half] = childCounts[i];
+        }
+        return right;
+    }
+
+    static void _removeChild(Internal *node, size_t slot) {
+        for (size_t i = slot; i + 1 < node->count; ++i) {
+            node->children[i] = node->children[i + 1];
+            node->counts[i] = node->counts[i + 1];
+        }
+        node->count--;
+    }
+
+    // Appends right to left and frees right when they fit into one node together.
+    static bool _merge(Node *left, Node *right) {
+        if (left->leaf) {
+            auto *l = static_cast<Leaf *>(left), *r = static_cast<Leaf *>(right);
+            if (l->count + r->count > LeafCapacity)
+                return false;
+            r->moveTo(0, *l);
+            delete r;
+        } else {
+            auto *l = static_cast<Internal *>(left), *r = static_cast<Internal *>(right);
+            if (l->count + r->count > Fanout)
+                return false;
+            for (size_t i = 0; i < r->count; ++i) {
+                l->children[l->count + i] = r->children[i];
+                l->counts[l->count + i] = r->counts[i];
+            }
+            l->count += r->count;
+            delete r;
+        }
+        return true;
+    }
+
+public:
+    CountedBTree() = default;
+
+    ~CountedBTree() {
+        _destroy(_root);
+    }
+
+    CountedBTree(const CountedBTree &) = delete;
+
+    CountedBTree &operator=(const CountedBTree &) = delete;
+
+    // Replaces the values by [first, last) level by level in O(n), all nodes but the last of a level are full.
+    template<typename It>
+    void assign(It first, It last) {
+        _destroy(_root);
+        _root = nullptr;
+        _totals = {};
+        std::vector<Node *> level;
+        std::vector<Counts> counts;
+        while (first != last) {
+            auto *leaf = new Leaf;
+            Counts total{};
+            for (; first != last && leaf->count < LeafCapacity; ++first) {
+                T value(*first);
+                _add(total, _weigh(value));
+                leaf->insertAt(leaf->count, std::move(value));
+            }
+            level.push_back(leaf);
+            counts.push_back(total);
+            _add(_totals, total);
+        }
+        while (level.size() > 1) {
+            size_t parents = 0;
+            for (size_t i = 0; i < level.size(); i += Fanout) {
+                auto *parent = new Internal;
+                Counts total{};
+                for (size_t j = i; j < level.size() && j < i + Fanout; ++j) {
+                    parent->children[parent->count] = level[j];
+                    parent->counts[parent->count++] = counts[j];
+                    _add(total, counts[j]);
+                }
+                level[parents] = parent;
+                counts[parents++] = total;
+            }
+            level.resize(parents);
+            counts.resize(parents);
+        }
+        if (!level.empty())
+            _root = level[0];
+    }
+
+    template<size_t counter = 0>
+    [[nodiscard]] size_t getSize() const {
+        return _totals[counter];
+    }
+
+    template<size_t counter = 0>
+    ValueOffset<const T> locate(size_t index) const {
+        if (index >= getSize<counter>())
+            throw std::out_of_range("Index out of range " + std::to_string(index) + " size is " +
+                                    std::to_string(getSize<counter>()));
+        size_t offset;
+        Leaf *leaf = _descend<counter>(index, offset, nullptr);
+        return {&leaf->values()[index], offset};
+    }
+
+    template<size_t counter = 0>
+    const T &find(size_t index) const {
+        return *locate<counter>(index).value;
+    }
+
+    T &find(size_t index) requires (Counters == 1) {
+        return const_cast<T &>(*locate(index).value);
+    }
+
+    // Units of counter in front of the value at index, index may be getSize().
+    template<size_t counter>
+    [[nodiscard]] size_t countBefore(size_t index) const {
+        _checkIndex(index, getSize());
+        if (index == getSize())
+            return getSize<counter>();
+        size_t before = 0;
+        const Node *node = _root;
+        while (!node->leaf) {
+            auto *internal = static_cast<const Internal *>(node);
+            size_t i = 0;
+            while (i + 1 < internal->count && index >= internal->counts[i][0]) {
+                index -= internal->counts[i][0];
+                before += internal->counts[i][counter];
+                ++i;
+            }
+            node = internal->children[i];
+        }
+        auto *leaf = static_cast<const Leaf *>(node);
+        for (size_t i = 0; i < index; ++i)
+            before += _weigh(leaf->values()[i])[counter];
+        return before;
+    }
+
+    // Index of the value holding the index-th unit of counter, countBefore<counter> the other way round.
+    template<size_t counter>
+    [[nodiscard]] size_t indexOf(size_t index) const {
+        _checkIndex(index + 1, getSize<counter>());
+        size_t before = 0;
+        const Node *node = _root;
+        while (!node->leaf) {
+            auto *internal = static_cast<const Internal *>(node);
+            size_t i = 0;
+            while (i + 1 < internal->count && index >= internal->counts[i][counter]) {
+                index -= internal->counts[i][counter];
+                before += internal->counts[i][0];
+                ++i;
+            }
+            node = internal->children[i];
+        }
+        auto *leaf = static_cast<const Leaf *>(node);
+        size_t slot = 0;
+        for (size_t weight; slot + 1 < leaf->count && index >= (weight = _weigh(leaf->values()[slot])[counter]);) {
+            index -= weight;
+            ++slot;
+        }
+        return before + slot;
+    }
+
+    void set(size_t index, T value) {
+        _checkIndex(index + 1, getSize());
+        Path path;
+        size_t offset;
+        Leaf *leaf = _descend<0>(index, offset, &path);
+        if constexpr (Counters > 1) {
+            Counts before = _weigh(leaf->values()[index]), after = _weigh(value);
+            for (size_t d = 0; d < path.depth; ++d) {
+                _subtract(path.nodes[d]->counts[path.slots[d]], before);
+                _add(path.nodes[d]->counts[path.slots[d]], after);
+            }
+            _subtract(_totals, before);
+            _add(_totals, after);
+        }
+        leaf->values()[index] = std::move(value);
+    }
+
+    void insert(size_t index, T value) {
+        _checkIndex(index, getSize());
+        // Appends fill the last leaf and start a new one instead of splitting it in halves, so a sequence built by
+        // appending has full nodes.
+        bool append = index == getSize();
+        Counts weight = _weigh(value);
+        _add(_totals, weight);
+        if (!_root) {
+            auto *leaf = new Leaf;
+            leaf->insertAt(0, std::move(value));
+            _root = leaf;
+            return;
+        }
+
+        Path path;
+        size_t offset;
+        Leaf *leaf = _descend<0, true>(index, offset, &path);
+        for (size_t d = 0; d < path.depth; ++d)
+            _add(path.nodes[d]->counts[path.slots[d]], weight);
+
+        Node *split = nullptr;
+        if (leaf->count == LeafCapacity) {
+            auto *right = new Leaf;
+            size_t half = append ? LeafCapacity : LeafCapacity / 2;
+            leaf->moveTo(half, *right);
+            if (append || index > half) {
+                index -= half;
+                leaf = right;
+            }
+            split = right;
+        }
+        leaf->insertAt(index, std::move(value));
+
+        // The parent counts still hold the whole node before the split, the new sibling takes its part over.
+        while (split) {
+            Counts counts = _total(split);
+            if (path.depth == 0) {
+                auto *root = new Internal;
+                root->children[0] = _root;
+                root->counts[0] = _totals;
+                _subtract(root->counts[0], counts);
+                root->children[1] = split;
+                root->counts[1] = counts;
+                root->count = 2;
+                _root = root;
+                break;
+            }
+            Internal *parent = path.nodes[--path.depth];
+            size_t slot = path.slots[path.depth];
+            _subtract(parent->counts[slot], counts);
+            split = _insertChild(parent, slot, split, counts, append);
+        }
+    }
+
+    T remove(size_t index) {
+        _checkIndex(index + 1, getSize());
+        Path path;
+        size_t offset;
+        Leaf *leaf = _descend<0>(index, offset, &path);
+        T value = leaf->removeAt(index);
+
+        Counts weight = _weigh(value);
+        _subtract(_totals, weight);
+        for (size_t d = 0; d < path.depth; ++d)
+            _subtract(path.nodes[d]->counts[path.slots[d]], weight);
+
+        // Empty nodes are dropped and a node under a quarter full is merged with a neighbour when they fit.
+        Node *node = leaf;
+        while (path.depth) {
+            Internal *parent = path.nodes[--path.depth];
+            size_t slot = path.slots[path.depth];
+            if (node->count == 0) {
+                _destroy(node);
+                _removeChild(parent, slot);
+            } else if (node->count < (node->leaf ? LeafCapacity : Fanout) / 4 && parent->count > 1) {
+                size_t left = slot + 1 < parent->count ? slot : slot - 1;
+                if (!_merge(parent->children[left], parent->children[left + 1]))
+                    break;
+                _add(parent->counts[left], parent->counts[left + 1]);
+                _removeChild(parent, left + 1);
+            } else {
+                break;
+            }
+            node = parent;
+        }
+        while (_root && !_root->leaf && _root->count <= 1) {
+            auto *internal = static_cast<Internal *>(_root);
+            _root = internal->count ? internal->children[0] : nullptr;
+            delete internal;
+        }
+        if (_root && _root->count == 0) {
+            _destroy(_root);
+            _root = nullptr;
+        }
+        return value;
+    }
+};
+
+// Array<T> over a CountedBTree, the same element interface for sequences long enough that the wide nodes pay off.
+template<typename T, size_t LeafCapacity = 64, size_t Fanout = 32>
+struct BTreeArray {
+    using tree_t = CountedBTree<T, LeafCapacity, Fanout>;
+
+    void assertIndex(size_t i) const {
+        if (i > size())
+            throw std::out_of_range(
+                    "Insert index out of range " + std::to_string(i) + " maximum is " + std::to_string(size()));
+    }
+
+    bool empty() const {
+        return !size();
+    }
+
+    size_t size() const {
+        return tree.getSize();
+    }
+
+    const T &operator[](size_t index) const {
+        return tree.find(index);
+    }
+
+    T &operator[](size_t index) {
+        return tree.find(index);
+    }
+
+    void insert(size_t index, T value) {
+        assertIndex(index);
+        tree.insert(index, std::move(value));
+    }
+
+    T erase(size_t index) {
+        return tree.remove(index);
+    }
+
+    tree_t tree;
+};
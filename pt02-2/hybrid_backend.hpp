@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Expects BasicTextEditorBackend (main.cpp) to be included first.
+
+/**
+ * Text in one array with the free space (the gap) kept at the last edit, typing moves the gap only when the cursor
+ * jumps. The newline index is lazy: line starts are exact up to the first edited position and are found again by
+ * scanning on the next line query past it.
+ */
+struct GapBuffer {
+    GapBuffer() = default;
+
+    explicit GapBuffer(std::string_view text) : _data(text.size() + MinGap), _gapBegin(text.size()),
+                                                 _gapEnd(_data.size()) {
+        std::memcpy(_data.data(), text.data(), text.size());
+        _newLines = size_t(std::count(text.begin(), text.end(), '\n'));
+    }
+
+    size_t size() const {
+        return _data.size() - gap();
+    }
+
+    size_t newLines() const {
+        return _newLines;
+    }
+
+    // Bytes held for the text, the gap included.
+    size_t capacity() const {
+        return _data.capacity();
+    }
+
+    char operator[](size_t i) const {
+        return i < _gapBegin ? _data[i] : _data[i + gap()];
+    }
+
+    void set(size_t i, char c) {
+        char &slot = i < _gapBegin ? _data[i] : _data[i + gap()];
+        if (slot == c) {
+            return;
+        }
+        _newLines += (c == '\n');
+        _newLines -= (slot == '\n');
+        if (slot == '\n' || c == '\n') {
+            invalidate(i);
+        }
+        slot = c;
+    }
+
+    void insert(size_t i, std::string_view text) {
+        reserve(text.size());
+        moveGap(i);
+        std::memcpy(_data.data() + _gapBegin, text.data(), text.size());
+        _gapBegin += text.size();
+        _newLines += size_t(std::count(text.begin(), text.end(), '\n'));
+        invalidate(i);
+    }
+
+    void erase(size_t i, size_t len) {
+        moveGap(i);
+        _newLines -= size_t(std::count(_data.begin() + std::ptrdiff_t(_gapEnd),
+                                       _data.begin() + std::ptrdiff_t(_gapEnd + len), '\n'));
+        _gapEnd += len;
+        invalidate(i);
+    }
+
+    void copy_to(size_t i, size_t len, char *buffer) const {
+        if (i < _gapBegin) {
+            size_t count = std::min(len, _gapBegin - i);
+            std::memcpy(buffer, _data.data() + i, count);
+            buffer += count;
+            len -= count;
+            i += count;
+        }
+        std::memcpy(buffer, _data.data() + i + gap(), len);
+    }
+
+    // Start of line r, 0 < r <= newLines().
+    size_t lineStart(size_t r) const {
+        while (_starts.size() < r) {
+            scan();
+        }
+        return _starts[r - 1];
+    }
+
+    // Number of newlines before i.
+    size_t newLinesBefore(size_t i) const {
+        while (_starts.size() < _newLines && (_starts.empty() || _starts.back() <= i)) {
+            scan();
+        }
+        return size_t(std::upper_bound(_starts.begin(), _starts.end(), i) - _starts.begin());
+    }
+
+private:
+    static constexpr size_t MinGap = 64;
+
+    std::vector<char> _data;
+    size_t _gapBegin = 0, _gapEnd = 0;
+    size_t _newLines = 0;
+    // Starts of lines 1, 2, ... known so far, line 0 starts at 0.
+    mutable std::vector<size_t> _starts;
+
+    size_t gap() const {
+        return _gapEnd - _gapBegin;
+    }
+
+    // Newlines from position i on may have moved.
+    void invalidate(size_t i) {
+        while (!_starts.empty() && _starts.back() > i) {
+            _starts.pop_back();
+        }
+    }
+
+    // Finds the next newline after the last known line start.
+    void scan() const {
+        size_t from = _starts.empty() ? 0 : _starts.back();
+        if (from < _gapBegin) {
+            auto found = (const char *) std::memchr(_data.data() + from, '\n', _gapBegin - from);
+            if (found) {
+                _starts.push_back(size_t(found - _data.data()) + 1);
+                return;
+            }
+            from = _gapBegin;
+        }
+        auto found = (const char *) std::memchr(_data.data() + from + gap(), '\n', size() - from);
+        _starts.push_back(size_t(found - _data.data()) - gap() + 1);
+    }
+
+    void moveGap(size_t i) {
+        if (i < _gapBegin) {
+            size_t count = _gapBegin - i;
+            std::memmove(_data.data() + _gapEnd - count, _data.data() + i, count);
+            _gapBegin -= count;
+            _gapEnd -= count;
+        } else if (i > _gapBegin) {
+            size_t count = i - _gapBegin;
+            std::memmove(_data.data() + _gapBegin, _data.data() + _gapEnd, count);
+            _gapBegin += count;
+            _gapEnd += count;
+        }
+    }
+
+    void reserve(size_t count) {
+        if (gap() >= count) {
+            return;
+        }
+        size_t tail = _data.size() - _gapEnd;
+        size_t capacity = std::max(_data.size() * 2, size() + count + MinGap);
+        _data.resize(capacity);
+        std::memmove(_data.data() + capacity - tail, _data.data() + _gapEnd, tail);
+        _gapEnd = capacity - tail;
+    }
+};
+
+/**
+ * TextEditorBackend which keeps documents up to SmallLimit characters in a GapBuffer and larger ones in the rope.
+ * The text moves into the rope once it grows past SmallLimit and back once it shrinks below a quarter of it, so
+ * editing around the limit does not convert it back and forth.
+ */
+template<size_t SmallLimit = (256 << 10), size_t ChunkCapacity = 1024>
+struct BasicHybridTextEditorBackend {
+    using rope_t = BasicTextEditorBackend<ChunkCapacity>;
+
+    void assertIndex(size_t i, size_t max) const {
+        if (i > max) {
+            throw std::out_of_range("Index out of range " + std::to_string(i) + " maximum is " +
+                                    std::to_string(max - 1));
+        }
+    }
+
+    void assertIndex(size_t i) const {
+        assertIndex(i, size());
+    }
+
+    void assertStrictIndex(size_t i, size_t max) const {
+        if (i >= max) {
+            throw std::out_of_range("Index out of range " + std::to_string(i) + " maximum is " +
+                                    std::to_string(size() - 1));
+        }
+    }
+
+    void assertStrictIndex(size_t i) const {
+        assertStrictIndex(i, size());
+    }
+
+    BasicHybridTextEditorBackend(const std::string &text) {
+        if (text.size() > SmallLimit) {
+            _large = std::make_unique<rope_t>(text);
+        } else {
+            _small = GapBuffer(text);
+        }
+    }
+
+    bool small() const {
+        return !_large;
+    }
+
+    const GapBuffer &gapBuffer() const {
+        return _small;
+    }
+
+    // nullptr while the text is small.
+    const rope_t *rope() const {
+        return _large.get();
+    }
+
+    size_t size() const {
+        return _large ? _large->size() : _small.size();
+    }
+
+    size_t lines() const {
+        return _large ? _large->lines() : _small.newLines() + 1;
+    }
+
+    char at(size_t i) const {
+        if (_large) {
+            return _large->at(i);
+        }
+        assertStrictIndex(i);
+        return _small[i];
+    }
+
+    void edit(size_t i, char c) {
+        if (_large) {
+            _large->edit(i, c);
+            return;
+        }
+        assertStrictIndex(i);
+        _small.set(i, c);
+    }
+
+    void insert(size_t i, char c) {
+        if (_large) {
+            _large->insert(i, c);
+            return;
+        }
+        insert(i, std::string_view(&c, 1));
+    }
+
+    void insert(size_t i, std::string_view text) {
+        if (_large) {
+            _large->insert(i, text);
+            return;
+        }
+        assertIndex(i);
+        _small.insert(i, text);
+        if (_small.size() > SmallLimit) {
+            grow();
+        }
+    }
+
+    void erase(size_t i) {
+        if (_large) {
+            _large->erase(i);
+            shrink();
+            return;
+        }
+        assertStrictIndex(i);
+        _small.erase(i, 1);
+    }
+
+    void erase(size_t i, size_t len) {
+        if (_large) {
+            _large->erase(i, len);
+            shrink();
+            return;
+        }
+        assertIndex(i);
+        assertIndex(len, size() - i);
+        _small.erase(i, len);
+    }
+
+    void copy_to(size_t i, size_t len, char *buffer) const {
+        if (_large) {
+            _large->copy_to(i, len, buffer);
+            return;
+        }
+        assertIndex(i);
+        assertIndex(len, size() - i);
+        _small.copy_to(i, len, buffer);
+    }
+
+    std::string substr(size_t i, size_t len) const {
+        assertIndex(i);
+        assertIndex(len, size() - i);
+        std::string result(len, '\0');
+        copy_to(i, len, result.data());
+        return result;
+    }
+
+    size_t line_start(size_t r) const {
+        if (_large) {
+            return _large->line_start(r);
+        }
+        assertIndex(r, lines() - 1);
+        return r == 0 ? 0 : _small.lineStart(r);
+    }
+
+    size_t line_length(size_t r) const {
+        assertIndex(r, lines() - 1);
+        if (r + 1 == lines()) {
+            return size() - line_start(r);
+        }
+        return line_start(r + 1) - line_start(r);
+    }
+
+    size_t char_to_line(size_t i) const {
+        if (_large) {
+            return _large->char_to_line(i);
+        }
+        assertIndex(i);
+        if (i == 0) {
+            return 0;
+        }
+        assertStrictIndex(i);
+        return _small.newLinesBefore(i);
+    }
+
+private:
+    GapBuffer _small;
+    std::unique_ptr<rope_t> _large;
+
+    void grow() {
+        _large = std::make_unique<rope_t>(substr(0, size()));
+        _small = GapBuffer();
+    }
+
+    void shrink() {
+        if (_large->size() >= SmallLimit / 4) {
+            return;
+        }
+        std::string text = _large->substr(0, _large->size());
+        _large = nullptr;
+        _small = GapBuffer(text);
+    }
+};
+
+using HybridTextEditorBackend = BasicHybridTextEditorBackend<>;
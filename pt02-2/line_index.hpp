@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "counted_btree.hpp"
+
+// Line lengths (a line counts its newline) in a counted B+-tree that sums them, so the start of a line, its length and
+// the line of a position are one descent over a few wide nodes instead of a descent through the rope. An edit inside
+// a line sets one length, every line an edit adds or removes is one insert or remove, all O(log lines).
+struct LineIndex {
+    bool built() const {
+        return _built;
+    }
+
+    void assign(const std::vector<size_t> &lengths) {
+        _lengths.assign(lengths.begin(), lengths.end());
+        _built = true;
+    }
+
+    size_t lines() const {
+        return _lengths.getSize();
+    }
+
+    size_t length(size_t r) const {
+        return _lengths.find(r);
+    }
+
+    size_t start(size_t r) const {
+        return _lengths.countBefore<1>(r);
+    }
+
+    // Line of position i, i <= total length.
+    size_t lineOf(size_t i) const {
+        return i < _lengths.getSize<1>() ? _lengths.indexOf<1>(i) : lines() - 1;
+    }
+
+    // [i, i + erased) was replaced by inserted, a no-op until the index is built.
+    void edit(size_t i, size_t erased, std::string_view inserted) {
+        if (!_built) {
+            return;
+        }
+        size_t first = lineOf(i), last = erased ? lineOf(i + erased) : first;
+        size_t newLine = inserted.find('\n');
+        if (first == last && newLine == std::string_view::npos) {
+            _lengths.set(first, length(first) + inserted.size() - erased);
+            return;
+        }
+        size_t head = i - start(first);
+        size_t tail = start(last) + length(last) - i - erased;
+        for (size_t r = first; r < last; ++r) {
+            _lengths.remove(first + 1);
+        }
+        // The first line ends with the first inserted newline, the text after the last one goes in front of the tail.
+        size_t line = first;
+        _lengths.set(line, head + (newLine == std::string_view::npos ? inserted.size() + tail : newLine + 1));
+        while (newLine != std::string_view::npos) {
+            size_t next = inserted.find('\n', newLine + 1);
+            _lengths.insert(++line, next == std::string_view::npos ? inserted.size() - newLine - 1 + tail
+                                                                    : next - newLine);
+            newLine = next;
+        }
+    }
+
+private:
+    struct Length {
+        size_t operator()(size_t length) const {
+            return length;
+        }
+    };
+
+    bool _built = false;
+    // Counter 0 counts lines, counter 1 sums their lengths.
+    CountedBTree<size_t, 64, 32, Length> _lengths;
+};
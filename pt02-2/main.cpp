@@ -7,6 +7,7 @@
 #include <memory>
 #include <limits>
 #include <optional>
+#include <tuple>
 #include <algorithm>
 #include <bitset>
 #include <list>
@@ -19,17 +20,36 @@
 #include <queue>
 #include <random>
 #include <type_traits>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <span>
 
 #endif
 
 #include "avl_tree_v2.hpp"
+#include "persistent_rope.hpp"
+#include "line_index.hpp"
 
 // MARK: Progtest
 
-using tree_t = AugmentedAVLTree<>;
-using NodeType = tree_t::NodeType;
+// Text is kept in a rope, every node owns a chunk of up to ChunkCapacity characters and the tree sums characters,
+// newlines, UTF-8 code points and tabs per chunk. Converting between any two of them is one descent by the first
+// counter, reading the other one off the path and finishing inside a single chunk.
+// The tree is edited in place, readers on other threads get an immutable copy of the text from snapshot()/published().
+// published() is the only member another thread may call while the backend is in use. The first line query builds
+// the line index through a const member, so not even const calls on one backend may run concurrently.
+template<size_t ChunkCapacity>
+struct BasicTextEditorBackend {
+    using rope_t = Rope<ChunkCapacity, IsUtf8Lead, IsTab>;
+    using tree_t = typename rope_t::Tree;
+    using NodeType = typename tree_t::NodeType;
+    using Chunk = typename rope_t::Chunk;
+    using snapshot_t = BasicTextSnapshot<ChunkCapacity>;
+
+    static constexpr auto CharSize = rope_t::CharSize;
+    static constexpr auto NewLineSize = rope_t::NewLineSize;
 
-struct TextEditorBackend {
     void assertIndex(size_t i, size_t max) const {
         if (i > max) {
             throw std::out_of_range("Index out of range " + std::to_string(i) + " maximum is " +
@@ -52,58 +72,141 @@ struct TextEditorBackend {
         assertStrictIndex(i, size());
     }
 
-    TextEditorBackend(const std::string &text) {
-        for (char c: text) {
-            insert(size(), c);
-        }
+    BasicTextEditorBackend(const std::string &text) {
+        size_t position = 0;
+        tree.build((text.size() + ChunkCapacity - 1) / ChunkCapacity, [&](Chunk &chunk) {
+            size_t count = std::min(ChunkCapacity, text.size() - position);
+            chunk.append(text.data() + position, count);
+            position += count;
+        });
     }
 
     size_t size() const {
-        return tree.getSize();
+        return tree.template getSize<CharSize>();
     }
 
     size_t lines() const {
-        return tree.getSize<AVLTreeNewLineCounterSize<tree_t>>() + 1;
+        return tree.template getSize<NewLineSize>() + 1;
     }
 
     char at(size_t i) const {
         assertStrictIndex(i);
-        auto &node = tree.find(i);
-        return node.getValue();
+        auto [node, offset] = tree.template locate<CharSize>(i);
+        return node->getValue()[offset];
     }
 
     void edit(size_t i, char c) {
         assertStrictIndex(i);
-        auto &node = tree.find(i);
-        node.setValue(c);
+        noteEdit(i, 1, std::string_view(&c, 1));
+        auto [node, offset] = tree.template locate<CharSize>(i);
+        if (node->getValue().set(offset, c)) {
+            node->bubbleUp();
+        }
     }
 
     void insert(size_t i, char c) {
         assertIndex(i);
-        tree.insert(i, c);
+        _version++;
+        noteEdit(i, 0, std::string_view(&c, 1));
+        insertChar(i, c);
+    }
+
+    // Short text goes straight into the chunk at i, otherwise that chunk is cut out of the tree and rebuilt together
+    // with the text into full chunks, everything around it is moved by split and join. O(log n + text.size()).
+    void insert(size_t i, std::string_view text) {
+        assertIndex(i);
+        _version++;
+        if (text.empty()) {
+            return;
+        }
+        noteEdit(i, 0, text);
+        if (!tree.root) {
+            replace(0, 0, std::array{text});
+            return;
+        }
+        auto [node, offset] = i == size() ? back() : tree.template locate<CharSize>(i);
+        Chunk &chunk = node->getValue();
+        if (chunk.size() + text.size() <= ChunkCapacity) {
+            chunk.insert(offset, text.data(), text.size());
+            node->bubbleUp();
+            return;
+        }
+        Chunk old = chunk;
+        replace(node->getIndex() - 1, 1, std::array{std::string_view(old.data(), offset), text,
+                                                     std::string_view(old.data() + offset, old.size() - offset)});
+    }
+
+    // Erases [i, i + len), the chunks it touches are replaced by what is left of the first and the last one.
+    void erase(size_t i, size_t len) {
+        assertIndex(i);
+        assertIndex(len, size() - i);
+        if (len == 0) {
+            return;
+        }
+        _version++;
+        noteEdit(i, len, {});
+        auto [first, firstOffset] = tree.template locate<CharSize>(i);
+        auto [last, lastOffset] = tree.template locate<CharSize>(i + len - 1);
+        size_t firstIndex = first->getIndex() - 1;
+        size_t lastIndex = last->getIndex() - 1;
+        Chunk head = first->getValue();
+        Chunk tail = last->getValue();
+        replace(firstIndex, lastIndex - firstIndex + 1,
+                std::array{std::string_view(head.data(), firstOffset),
+                           std::string_view(tail.data() + lastOffset + 1, tail.size() - lastOffset - 1)});
+    }
+
+    void copy_to(size_t i, size_t len, char *buffer) const {
+        assertIndex(i);
+        assertIndex(len, size() - i);
+        if (len == 0) {
+            return;
+        }
+        auto [node, offset] = tree.template locate<CharSize>(i);
+        while (len) {
+            const Chunk &chunk = node->getValue();
+            size_t count = std::min(len, chunk.size() - offset);
+            std::memcpy(buffer, chunk.data() + offset, count);
+            buffer += count;
+            len -= count;
+            offset = 0;
+            node = node->next();
+        }
+    }
+
+    std::string substr(size_t i, size_t len) const {
+        assertIndex(i);
+        assertIndex(len, size() - i);
+        std::string result(len, '\0');
+        copy_to(i, len, result.data());
+        return result;
     }
 
     void erase(size_t i) {
         assertStrictIndex(i);
-        auto &node = tree.find(i);
-        tree.remove(node);
+        _version++;
+        noteEdit(i, 1, {});
+        auto [node, offset] = tree.template locate<CharSize>(i);
+        Chunk &chunk = node->getValue();
+        chunk.erase(offset);
+        if (chunk.size() == 0) {
+            tree.remove(*node);
+            return;
+        }
+        node->bubbleUp();
+        if (chunk.size() < ChunkCapacity / 4) {
+            merge(*node);
+        }
     }
 
     size_t line_start(size_t r) const {
         assertIndex(r, lines() - 1);
-        if (r == 0) {
-            return 0;
-        }
-        auto &node = tree.find<AVLTreeNewLineCounterSize<tree_t>>(r - 1);
-        return node.getIndex();
+        return lineIndex().start(r);
     }
 
     size_t line_length(size_t r) const {
         assertIndex(r, lines() - 1);
-        if (r + 1 == lines()) {
-            return size() - line_start(r);
-        }
-        return line_start(r + 1) - line_start(r);
+        return lineIndex().length(r);
     }
 
     size_t char_to_line(size_t i) const {
@@ -111,9 +214,570 @@ struct TextEditorBackend {
         if (i == 0) {
             return 0;
         }
-        auto &node = tree.find(i);
-        return node.getIndex<AVLTreeNewLineCounterSize<tree_t>>() - (node.getValue() == '\n');
+        assertStrictIndex(i);
+        return lineIndex().lineOf(i);
+    }
+
+    size_t code_points() const {
+        return tree.template getSize<rope_t::template CountSize<IsUtf8Lead>>();
+    }
+
+    // Code points in front of the character i, continuation bytes of a multibyte code point map to the one they are in.
+    size_t char_to_code_point(size_t i) const {
+        assertIndex(i);
+        return countBefore<IsUtf8Lead>(i);
+    }
+
+    size_t code_point_to_char(size_t cp) const {
+        assertIndex(cp, code_points());
+        return cp == code_points() ? size() : position<IsUtf8Lead>(cp);
+    }
+
+    // Code points between the start of the line and i, i may be size() as a cursor at the end of the text.
+    size_t char_to_column(size_t i) const {
+        assertIndex(i);
+        return countBefore<IsUtf8Lead>(i) - countBefore<IsUtf8Lead>(lineStartOf(i));
+    }
+
+    // Approximate display column, every code point takes one cell except tabs taking tab_width, at least 1.
+    size_t char_to_visual_column(size_t i, size_t tab_width = 4) const {
+        assertIndex(i);
+        if (tab_width == 0) {
+            throw std::invalid_argument("Tab width has to be at least 1");
+        }
+        size_t start = lineStartOf(i);
+        return countBefore<IsUtf8Lead>(i) - countBefore<IsUtf8Lead>(start) +
+               (countBefore<IsTab>(i) - countBefore<IsTab>(start)) * (tab_width - 1);
+    }
+
+    // column counts code points, the end of the line (in front of its newline) is a valid column.
+    size_t line_column_to_char(size_t r, size_t column) const {
+        assertIndex(r, lines() - 1);
+        size_t start = line_start(r);
+        size_t end = r + 1 == lines() ? size() : line_start(r + 1) - 1;
+        size_t first = countBefore<IsUtf8Lead>(start);
+        assertIndex(column, countBefore<IsUtf8Lead>(end) - first);
+        return code_point_to_char(first + column);
+    }
+
+    // One edit of a batch, [position, position + erase) is replaced by text. Positions refer to the text before the
+    // batch, apply_edits rewrites each to where its edit ends in the text after it (the new cursor position).
+    struct Edit {
+        size_t position;
+        size_t erase = 0;
+        std::string_view text;
+    };
+
+    // Applies edits sorted by position, none starting inside the range erased by the previous one, in a single left
+    // to right walk over the chunks. The counters above every edited chunk are updated once at the end instead of
+    // after every edit, the walk descends from the root again only to skip a long gap. Typing with many cursors is
+    // one call instead of an insert per cursor and shifting the other cursors by hand.
+    void apply_edits(std::span<Edit> edits) {
+        size_t end = 0;
+        for (size_t k = 0; k < edits.size(); ++k) {
+            assertIndex(edits[k].position);
+            assertIndex(edits[k].erase, size() - edits[k].position);
+            if (k && edits[k].position < end) {
+                throw std::invalid_argument("Edits are not sorted by position or overlap");
+            }
+            end = edits[k].position + edits[k].erase;
+        }
+        if (edits.empty()) {
+            return;
+        }
+        _version++;
+        if (!tree.root) {
+            // All edits are at 0 and erase nothing then, an empty chunk to type into stays only if one of them types.
+            if (std::all_of(edits.begin(), edits.end(), [](const Edit &edit) { return edit.text.empty(); })) {
+                return;
+            }
+            tree.insert(0, Chunk());
+        }
+
+        // Walking further than this costs more than a descent and updating the chunks edited so far.
+        constexpr size_t farAway = 16 * ChunkCapacity;
+        std::vector<NodeType *> touched, emptied;
+        NodeType *node = nullptr;
+        size_t offset = 0, at = 0, shift = 0;
+        for (Edit &edit: edits) {
+            size_t target = edit.position + shift;
+            noteEdit(target, edit.erase, edit.text);
+            if (!node || target - at > farAway) {
+                settle(touched);
+                auto found = target == size() ? back() : tree.template locate<CharSize>(target);
+                node = found.node;
+                offset = found.offset;
+                at = target;
+                // At a chunk boundary typing goes to the end of the previous chunk, as when walking.
+                if (NodeType *prev = offset == 0 ? node->prev() : nullptr; prev && !prev->getValue().full()) {
+                    node = prev;
+                    offset = prev->getValue().size();
+                }
+            }
+            while (target - at > node->getValue().size() - offset) {
+                at += node->getValue().size() - offset;
+                node = node->next();
+                offset = 0;
+            }
+            offset += target - at;
+
+            for (size_t left = edit.erase; left;) {
+                Chunk &chunk = node->getValue();
+                if (offset == chunk.size()) {
+                    node = node->next();
+                    offset = 0;
+                    continue;
+                }
+                size_t take = std::min(left, chunk.size() - offset);
+                chunk.erase(offset, take);
+                left -= take;
+                touchOnce(touched, node);
+                if (chunk.size() == 0) {
+                    touchOnce(emptied, node);
+                }
+            }
+            if (!edit.text.empty()) {
+                insertInto(node, offset, edit.text, touched);
+            }
+            at = target + edit.text.size();
+            // size_t wraps, so shrinking edits subtract
+            shift += edit.text.size() - edit.erase;
+            edit.position = at;
+        }
+        settle(touched);
+        for (NodeType *empty: emptied) {
+            if (empty->getValue().size() == 0) {
+                tree.remove(*empty);
+            }
+        }
+    }
+
+    // A position in the text that remembers its chunk. Typing and erasing next to it edits only that chunk and adds
+    // the typed or erased character to the counters on its root path, no descent and no recomputing of counters per
+    // keystroke. Any other edit of the text invalidates the cursor, it then finds its index again by one descent,
+    // the index itself is not shifted by those edits.
+    class Cursor {
+    public:
+        size_t position() const {
+            return _index;
+        }
+
+        void seek(size_t i) {
+            _backend->assertIndex(i);
+            _index = i;
+            _relocate();
+        }
+
+        // Short moves walk the neighbouring chunks, long ones descend from the root.
+        void move(std::ptrdiff_t delta) {
+            _sync();
+            size_t target = _index + delta;
+            _backend->assertIndex(target);
+            if (!_node || size_t(delta < 0 ? -delta : delta) > 2 * ChunkCapacity) {
+                seek(target);
+                return;
+            }
+            _index = target;
+            while (delta > 0) {
+                size_t step = std::min(size_t(delta), _node->getValue().size() - _offset);
+                _offset += step;
+                delta -= std::ptrdiff_t(step);
+                if (delta) {
+                    _node = _node->next();
+                    _offset = 0;
+                }
+            }
+            while (delta < 0) {
+                if (_offset == 0) {
+                    _node = _node->prev();
+                    _offset = _node->getValue().size();
+                }
+                size_t step = std::min(size_t(-delta), _offset);
+                _offset -= step;
+                delta += std::ptrdiff_t(step);
+            }
+        }
+
+        // Character right after the cursor.
+        char get() {
+            _sync();
+            _backend->assertStrictIndex(_index);
+            if (_offset == _node->getValue().size()) {
+                return _node->next()->getValue()[0];
+            }
+            return _node->getValue()[_offset];
+        }
+
+        // Types c in front of the cursor, the cursor ends up right after it.
+        void insert(char c) {
+            _sync();
+            if (!_node || _node->getValue().full()) {
+                _backend->insert(_index++, c);
+                _relocate();
+                return;
+            }
+            _backend->noteEdit(_index, 0, std::string_view(&c, 1));
+            _node->getValue().insert(_offset++, c);
+            rope_t::countChar(*_node, c, true);
+            _index++;
+            _version = ++_backend->_version;
+        }
+
+        // Backspace.
+        void erase_before() {
+            _sync();
+            if (_index == 0) {
+                throw std::out_of_range("Nothing to erase in front of the cursor");
+            }
+            Chunk &chunk = _node->getValue();
+            if (_offset == 0 || chunk.size() == 1) {
+                _backend->erase(--_index);
+                _relocate();
+                return;
+            }
+            _backend->noteEdit(_index - 1, 1, {});
+            char erased = chunk[--_offset];
+            chunk.erase(_offset);
+            rope_t::countChar(*_node, erased, false);
+            _index--;
+            _version = ++_backend->_version;
+        }
+
+        // Delete.
+        void erase_after() {
+            _sync();
+            _backend->assertStrictIndex(_index);
+            Chunk &chunk = _node->getValue();
+            if (_offset == chunk.size() || chunk.size() == 1) {
+                _backend->erase(_index);
+                _relocate();
+                return;
+            }
+            _backend->noteEdit(_index, 1, {});
+            char erased = chunk[_offset];
+            chunk.erase(_offset);
+            rope_t::countChar(*_node, erased, false);
+            _version = ++_backend->_version;
+        }
+
+    private:
+        friend struct BasicTextEditorBackend;
+
+        Cursor(BasicTextEditorBackend &backend, size_t i) : _backend(&backend), _index(i) {
+            _relocate();
+        }
+
+        void _sync() {
+            if (_version != _backend->_version) {
+                _relocate();
+            }
+        }
+
+        void _relocate() {
+            _version = _backend->_version;
+            if (!_backend->tree.root) {
+                _node = nullptr;
+                _offset = 0;
+                return;
+            }
+            auto found = _index == _backend->size() ? _backend->back()
+                                                    : _backend->tree.template locate<CharSize>(_index);
+            _node = found.node;
+            _offset = found.offset;
+        }
+
+        BasicTextEditorBackend *_backend;
+        NodeType *_node = nullptr;
+        size_t _offset = 0;
+        size_t _index;
+        size_t _version = 0;
+    };
+
+    Cursor cursor(size_t i) {
+        assertIndex(i);
+        return Cursor(*this, i);
+    }
+
+    // Immutable copy of the current text for readers on other threads. The first call builds a persistent rope of the
+    // text in O(n). From then on edits are queued, typing runs folded into one, and the next snapshot() or publish()
+    // copies one path of the persistent rope per queued edit, so a snapshot right after the previous one is O(1).
+    // Replaying the queue changes the backend, this is an edit thread call like publish().
+    snapshot_t snapshot() {
+        return snapshot_t(persistentRoot());
+    }
+
+    // Makes the current text the one published() returns.
+    void publish() {
+        _published.store(persistentRoot());
+    }
+
+    // The text of the last publish(), the one thread-safe entry point: any thread may call it while another edits.
+    snapshot_t published() const {
+        return snapshot_t(_published.load());
     }
 
     tree_t tree;
+
+private:
+    using persistent_t = persistent::Rope<ChunkCapacity>;
+
+    // Bumped by every edit that can move characters, cursors holding an older one locate their index again.
+    size_t _version = 0;
+    // Built by the first line query, every edit after it keeps it up to date. About a word per line.
+    mutable LineIndex _lineIndex;
+    // [position, position + erase) of the text before it replaced by text.
+    struct PendingEdit {
+        size_t position;
+        size_t erase;
+        std::string text;
+    };
+
+    // Replayed by persistentRoot() at the latest once this many are queued, bounds the memory of the queue.
+    static constexpr size_t MaxPending = 1024;
+
+    // Persistent rope of the text once a snapshot was asked for, behind it by the pending edits. Snapshots share
+    // all of it but the paths edited after them.
+    std::optional<typename persistent_t::Ptr> _persistent;
+    std::vector<PendingEdit> _pending;
+    PublishedText<ChunkCapacity> _published;
+
+    const typename persistent_t::Ptr &persistentRoot() {
+        if (!_persistent) {
+            _persistent = persistent_t::build(substr(0, size()));
+        }
+        for (const PendingEdit &edit: _pending) {
+            _persistent = persistent_t::replace(*_persistent, edit.position, edit.erase, edit.text);
+        }
+        _pending.clear();
+        return *_persistent;
+    }
+
+    // Every edit reports that [i, i + erase) is replaced by text here, before the tree changes.
+    void noteEdit(size_t i, size_t erase, std::string_view text) {
+        _lineIndex.edit(i, erase, text);
+        if (!_persistent) {
+            return;
+        }
+        // An edit touching the text the previous one wrote is folded into it, typing, backspacing and deleting runs
+        // stay a single edit.
+        if (!_pending.empty()) {
+            PendingEdit &last = _pending.back();
+            size_t written = last.position + last.text.size();
+            if (i <= written && i + erase >= last.position) {
+                size_t end = i + erase > written ? i + erase - last.text.size() + last.erase
+                                                 : last.position + last.erase;
+                size_t from = std::max(i, last.position) - last.position;
+                size_t to = std::min(i + erase, written) - last.position;
+                last.text.replace(from, to - from, text);
+                last.position = std::min(i, last.position);
+                last.erase = end - last.position;
+                return;
+            }
+        }
+        _pending.push_back({i, erase, std::string(text)});
+        if (_pending.size() >= MaxPending) {
+            persistentRoot();
+        }
+    }
+
+    const LineIndex &lineIndex() const {
+        if (!_lineIndex.built()) {
+            std::vector<size_t> lengths;
+            size_t current = 0;
+            if (tree.root) {
+                NodeType *node = tree.root;
+                while (node->left)
+                    node = node->left;
+                for (; node; node = node->next()) {
+                    std::string_view chunk(node->getValue().data(), node->getValue().size());
+                    for (size_t newLine; (newLine = chunk.find('\n')) != std::string_view::npos;) {
+                        lengths.push_back(current + newLine + 1);
+                        current = 0;
+                        chunk.remove_prefix(newLine + 1);
+                    }
+                    current += chunk.size();
+                }
+            }
+            lengths.push_back(current);
+            _lineIndex.assign(lengths);
+        }
+        return _lineIndex;
+    }
+
+    // Bytes matching Predicate in front of i, i <= size().
+    template<typename Predicate>
+    size_t countBefore(size_t i) const {
+        if (i == size()) {
+            return tree.template getSize<rope_t::template CountSize<Predicate>>();
+        }
+        auto [node, offset] = tree.template locate<CharSize>(i);
+        return node->template getOffset<rope_t::template CountSize<Predicate>>() +
+               node->getValue().template countBefore<Predicate>(offset);
+    }
+
+    // Position of the matching byte with the given index (0 based).
+    template<typename Predicate>
+    size_t position(size_t index) const {
+        auto [node, offset] = tree.template locate<rope_t::template CountSize<Predicate>>(index);
+        return node->template getOffset<CharSize>() + node->getValue().template find<Predicate>(offset);
+    }
+
+    static void touchOnce(std::vector<NodeType *> &nodes, NodeType *node) {
+        if (nodes.empty() || nodes.back() != node) {
+            nodes.push_back(node);
+        }
+    }
+
+    // Updates the counters of the touched nodes and of all their ancestors, each node once and below its parent.
+    // touched is in order, so the part of a root path not shared with the previous one ends below their common
+    // ancestor, which is the first node met on the previous path. Heights grow strictly towards the root, the
+    // previous path is kept by height and the union is updated by increasing height.
+    static void settle(std::vector<NodeType *> &touched) {
+        if (touched.size() <= 1) {
+            for (NodeType *node: touched) {
+                node->bubbleUp();
+            }
+            touched.clear();
+            return;
+        }
+        NodeType *previous[std::numeric_limits<decltype(NodeType::maxDepth)>::max() + 1] = {};
+        std::vector<NodeType *> nodes;
+        for (NodeType *node: touched) {
+            for (; node && previous[node->maxDepth] != node; node = node->parent) {
+                previous[node->maxDepth] = node;
+                nodes.push_back(node);
+            }
+        }
+        std::sort(nodes.begin(), nodes.end(), [](const NodeType *a, const NodeType *b) {
+            return a->maxDepth < b->maxDepth;
+        });
+        for (NodeType *node: nodes) {
+            updateAll(*node);
+        }
+        touched.clear();
+    }
+
+    // Inserts text at offset into the chunk of node during apply_edits. A chunk too full for short text is split in
+    // halves like in insert, longer text splits it at offset and the rest goes into new chunks after it. node and
+    // offset end up right after the text.
+    void insertInto(NodeType *&node, size_t &offset, std::string_view text, std::vector<NodeType *> &touched) {
+        Chunk &chunk = node->getValue();
+        touchOnce(touched, node);
+        if (chunk.size() + text.size() > ChunkCapacity && text.size() <= ChunkCapacity / 2) {
+            NodeType &half = tree.insert(node->getIndex(), chunk.splitOff(chunk.size() / 2));
+            if (offset > chunk.size()) {
+                offset -= chunk.size();
+                node = &half;
+                touchOnce(touched, node);
+            }
+        }
+        if (node->getValue().size() + text.size() <= ChunkCapacity) {
+            node->getValue().insert(offset, text.data(), text.size());
+            offset += text.size();
+            return;
+        }
+        Chunk tail = chunk.splitOff(offset);
+        size_t take = std::min(ChunkCapacity - chunk.size(), text.size());
+        chunk.append(text.data(), take);
+        text.remove_prefix(take);
+        while (!text.empty()) {
+            Chunk next;
+            take = std::min(ChunkCapacity, text.size());
+            next.append(text.data(), take);
+            text.remove_prefix(take);
+            node = &tree.insert(node->getIndex(), next);
+        }
+        offset = node->getValue().size();
+        if (offset + tail.size() <= ChunkCapacity) {
+            node->getValue().append(tail);
+            touchOnce(touched, node);
+        } else {
+            tree.insert(node->getIndex(), tail);
+        }
+    }
+
+    // insert without the bookkeeping, splitting a full chunk retries it once.
+    void insertChar(size_t i, char c) {
+        if (!tree.root) {
+            Chunk chunk;
+            chunk.insert(0, c);
+            tree.insert(0, chunk);
+            return;
+        }
+
+        auto [node, offset] = i == size() ? back() : tree.template locate<CharSize>(i);
+        Chunk &chunk = node->getValue();
+        if (chunk.full()) {
+            // Typing at the end of a chunk starts a new one so appending leaves full chunks behind.
+            if (offset == chunk.size()) {
+                Chunk next;
+                next.insert(0, c);
+                tree.insert(node->getIndex(), next);
+                return;
+            }
+            Chunk tail = chunk.splitOff(chunk.size() / 2);
+            node->bubbleUp();
+            tree.insert(node->getIndex(), tail);
+            insertChar(i, c);
+            return;
+        }
+        chunk.insert(offset, c);
+        node->bubbleUp();
+    }
+
+    size_t lineStartOf(size_t i) const {
+        return lineIndex().start(lineIndex().lineOf(i));
+    }
+
+    // Position right after the last character, inside the last chunk.
+    NodeOffset<NodeType> back() {
+        NodeType *node = tree.root;
+        while (node->right)
+            node = node->right;
+        return {node, node->getValue().size()};
+    }
+
+    // Swaps the chunks [first, first + count) for full chunks built from the concatenated pieces.
+    template<size_t N>
+    void replace(size_t first, size_t count, const std::array<std::string_view, N> &pieces) {
+        auto [before, rest] = tree.split(tree.root, first);
+        auto [removed, after] = tree.split(rest, count);
+        tree.root = nullptr;
+        tree.destroyNodes(removed);
+
+        size_t total = 0;
+        for (auto piece: pieces) {
+            total += piece.size();
+        }
+        size_t piece = 0, position = 0;
+        NodeType *middle = tree.buildNodes((total + ChunkCapacity - 1) / ChunkCapacity, [&](Chunk &chunk) {
+            while (!chunk.full() && piece < N) {
+                size_t take = std::min(ChunkCapacity - chunk.size(), pieces[piece].size() - position);
+                chunk.append(pieces[piece].data() + position, take);
+                position += take;
+                if (position == pieces[piece].size()) {
+                    piece++;
+                    position = 0;
+                }
+            }
+        });
+        tree.root = tree.join(tree.join(before, middle), after);
+    }
+
+    // Folds an almost empty chunk into a neighbour when they fit together, so erasing does not leave a long tail
+    // of nearly empty nodes behind.
+    void merge(NodeType &node) {
+        Chunk &chunk = node.getValue();
+        if (NodeType *next = node.next(); next && chunk.size() + next->getValue().size() <= ChunkCapacity) {
+            chunk.append(next->getValue());
+            node.bubbleUp();
+            tree.remove(*next);
+        } else if (NodeType *prev = node.prev(); prev && chunk.size() + prev->getValue().size() <= ChunkCapacity) {
+            prev->getValue().append(chunk);
+            prev->bubbleUp();
+            tree.remove(node);
+        }
+    }
 };
+
+using TextEditorBackend = BasicTextEditorBackend<1024>;
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "avl_tree_v2.hpp"
+
+namespace persistent {
+
+    /**
+     * Immutable AVL rope, text lives in TextChunks in the leaves and inner nodes only sum characters and newlines.
+     * Every edit copies the path from the root to one leaf and returns a new root, the old root stays valid and
+     * shares everything else, so keeping a version costs O(log n) small nodes plus one chunk.
+     */
+    template<size_t Capacity>
+    struct Rope {
+        using Chunk = TextChunk<Capacity>;
+
+        struct Node;
+        using Ptr = std::shared_ptr<const Node>;
+
+        struct Node {
+            Ptr left, right;
+            std::shared_ptr<const Chunk> chunk;
+            size_t chars;
+            size_t newLines;
+            int height;
+        };
+
+        static size_t chars(const Ptr &node) {
+            return node ? node->chars : 0;
+        }
+
+        static size_t newLines(const Ptr &node) {
+            return node ? node->newLines : 0;
+        }
+
+        static int height(const Ptr &node) {
+            return node ? node->height : 0;
+        }
+
+        static Ptr leaf(const Chunk &chunk) {
+            if (chunk.size() == 0)
+                return nullptr;
+            return std::make_shared<const Node>(
+                    Node{nullptr, nullptr, std::make_shared<const Chunk>(chunk), chunk.size(), chunk.newLines(), 1});
+        }
+
+        static Ptr node(Ptr left, Ptr right) {
+            if (!left)
+                return right;
+            if (!right)
+                return left;
+            size_t charCount = left->chars + right->chars;
+            size_t newLineCount = left->newLines + right->newLines;
+            int depth = std::max(left->height, right->height) + 1;
+            return std::make_shared<const Node>(
+                    Node{std::move(left), std::move(right), nullptr, charCount, newLineCount, depth});
+        }
+
+        // Heights of left and right may differ by up to 2.
+        static Ptr balance(Ptr left, Ptr right) {
+            if (!left || !right)
+                return node(std::move(left), std::move(right));
+            if (height(left) > height(right) + 1) {
+                if (height(left->left) >= height(left->right))
+                    return node(left->left, node(left->right, std::move(right)));
+                return node(node(left->left, left->right->left), node(left->right->right, std::move(right)));
+            }
+            if (height(right) > height(left) + 1) {
+                if (height(right->right) >= height(right->left))
+                    return node(node(std::move(left), right->left), right->right);
+                return node(node(std::move(left), right->left->left), node(right->left->right, right->right));
+            }
+            return node(std::move(left), std::move(right));
+        }
+
+        static Ptr join(Ptr left, Ptr right) {
+            if (height(left) > height(right) + 1)
+                return balance(left->left, join(left->right, std::move(right)));
+            if (height(right) > height(left) + 1)
+                return balance(join(std::move(left), right->left), right->right);
+            return node(std::move(left), std::move(right));
+        }
+
+        static Ptr build(std::string_view text) {
+            size_t count = (text.size() + Capacity - 1) / Capacity;
+            return _build(text, 0, count);
+        }
+
+        /**
+         * Copies the path to the leaf holding index and replaces that leaf by modify(chunk, offset), which gets a
+         * private copy of the chunk and returns the new subtree (nullptr drops the leaf). With append the index may be
+         * one past the end of a leaf, which is what inserting needs.
+         */
+        template<bool append, typename Modify>
+        static Ptr update(const Ptr &current, size_t index, Modify &modify) {
+            if (!current->left) {
+                Chunk chunk = *current->chunk;
+                return modify(chunk, index);
+            }
+            size_t left = current->left->chars;
+            if (append ? index <= left : index < left)
+                return rejoin(update<append>(current->left, index, modify), current->right);
+            return rejoin(current->left, update<append>(current->right, index - left, modify));
+        }
+
+        // Short text, at most Capacity / 2 characters, goes into the chunk at index, split in halves when it is too full.
+        static Ptr insert(const Ptr &root, size_t index, std::string_view text) {
+            if (!root)
+                return build(text);
+            auto modify = [text](Chunk &chunk, size_t offset) {
+                if (chunk.size() + text.size() <= Capacity) {
+                    chunk.insert(offset, text.data(), text.size());
+                    return leaf(chunk);
+                }
+                Chunk tail = chunk.splitOff(chunk.size() / 2);
+                if (offset <= chunk.size())
+                    chunk.insert(offset, text.data(), text.size());
+                else
+                    tail.insert(offset - chunk.size(), text.data(), text.size());
+                return node(leaf(chunk), leaf(tail));
+            };
+            return update<true>(root, index, modify);
+        }
+
+        static Ptr erase(const Ptr &root, size_t index) {
+            auto modify = [](Chunk &chunk, size_t offset) {
+                chunk.erase(offset);
+                return leaf(chunk);
+            };
+            return update<false>(root, index, modify);
+        }
+
+        static Ptr set(const Ptr &root, size_t index, char c) {
+            auto modify = [c](Chunk &chunk, size_t offset) {
+                chunk.set(offset, c);
+                return leaf(chunk);
+            };
+            return update<false>(root, index, modify);
+        }
+
+        // The first index characters and the rest.
+        static std::pair<Ptr, Ptr> split(const Ptr &current, size_t index) {
+            if (!current || index == 0)
+                return {nullptr, current};
+            if (index >= current->chars)
+                return {current, nullptr};
+            if (!current->left) {
+                Chunk head = *current->chunk;
+                Chunk tail = head.splitOff(index);
+                return {leaf(head), leaf(tail)};
+            }
+            size_t left = current->left->chars;
+            if (index < left) {
+                auto [before, after] = split(current->left, index);
+                return {std::move(before), join(std::move(after), current->right)};
+            }
+            auto [before, after] = split(current->right, index - left);
+            return {join(current->left, std::move(before)), std::move(after)};
+        }
+
+        // [position, position + count) replaced by text. Single characters and short insertions copy one path,
+        // anything else is split out and joined back, O(log^2 n + text.size()).
+        static Ptr replace(const Ptr &root, size_t position, size_t count, std::string_view text) {
+            if (count == 0 && text.size() <= Capacity / 2)
+                return text.empty() ? root : insert(root, position, text);
+            if (count == 1 && text.empty())
+                return erase(root, position);
+            if (count == 1 && text.size() == 1)
+                return set(root, position, text[0]);
+            auto [before, rest] = split(root, position);
+            auto [removed, after] = split(rest, count);
+            return join(join(std::move(before), build(text)), std::move(after));
+        }
+
+        // Leaf holding index and the offset inside it, index < chars(root).
+        static std::pair<const Node *, size_t> locate(const Node *current, size_t index) {
+            while (current->left) {
+                if (index < current->left->chars) {
+                    current = current->left.get();
+                } else {
+                    index -= current->left->chars;
+                    current = current->right.get();
+                }
+            }
+            return {current, index};
+        }
+
+        // Newlines in front of index.
+        static size_t newLinesBefore(const Node *current, size_t index) {
+            size_t count = 0;
+            while (current->left) {
+                if (index < current->left->chars) {
+                    current = current->left.get();
+                } else {
+                    index -= current->left->chars;
+                    count += current->left->newLines;
+                    current = current->right.get();
+                }
+            }
+            return count + current->chunk->countNewLines(index);
+        }
+
+        // Position of the newline with the given index (0 based), newLine < newLines(root).
+        static size_t findNewLine(const Node *current, size_t newLine) {
+            size_t position = 0;
+            while (current->left) {
+                if (newLine < current->left->newLines) {
+                    current = current->left.get();
+                } else {
+                    newLine -= current->left->newLines;
+                    position += current->left->chars;
+                    current = current->right.get();
+                }
+            }
+            return position + current->chunk->findNewLine(newLine);
+        }
+
+    private:
+        static Ptr _build(std::string_view text, size_t first, size_t last) {
+            if (first == last)
+                return nullptr;
+            if (last - first == 1) {
+                Chunk chunk;
+                size_t begin = first * Capacity;
+                chunk.append(text.data() + begin, std::min(Capacity, text.size() - begin));
+                return leaf(chunk);
+            }
+            size_t middle = first + (last - first) / 2;
+            return node(_build(text, first, middle), _build(text, middle, last));
+        }
+
+        // Puts a copied path back together, two small sibling leaves left behind by erasing become one.
+        static Ptr rejoin(Ptr left, Ptr right) {
+            if (left && right && !left->left && !right->left && left->chars + right->chars <= Capacity &&
+                std::min(left->chars, right->chars) < Capacity / 4) {
+                Chunk chunk = *left->chunk;
+                chunk.append(*right->chunk);
+                return leaf(chunk);
+            }
+            return balance(std::move(left), std::move(right));
+        }
+    };
+}
+
+/**
+ * Read only view of one state of the text. Copying it copies the root pointer, the nodes below are immutable and
+ * shared, so any number of threads can query their own copies while the backend it came from keeps editing.
+ */
+template<size_t ChunkCapacity>
+struct BasicTextSnapshot {
+    using rope_t = persistent::Rope<ChunkCapacity>;
+    using Chunk = typename rope_t::Chunk;
+    using Ptr = typename rope_t::Ptr;
+
+    BasicTextSnapshot() = default;
+
+    explicit BasicTextSnapshot(Ptr root) : root(std::move(root)) {
+    }
+
+    void assertIndex(size_t i, size_t max) const {
+        if (i > max) {
+            throw std::out_of_range("Index out of range " + std::to_string(i) + " maximum is " +
+                                    std::to_string(max - 1));
+        }
+    }
+
+    void assertIndex(size_t i) const {
+        assertIndex(i, size());
+    }
+
+    void assertStrictIndex(size_t i, size_t max) const {
+        if (i >= max) {
+            throw std::out_of_range("Index out of range " + std::to_string(i) + " maximum is " +
+                                    std::to_string(size() - 1));
+        }
+    }
+
+    void assertStrictIndex(size_t i) const {
+        assertStrictIndex(i, size());
+    }
+
+    size_t size() const {
+        return rope_t::chars(root);
+    }
+
+    size_t lines() const {
+        return rope_t::newLines(root) + 1;
+    }
+
+    char at(size_t i) const {
+        assertStrictIndex(i);
+        auto [leaf, offset] = rope_t::locate(root.get(), i);
+        return (*leaf->chunk)[offset];
+    }
+
+    size_t line_start(size_t r) const {
+        assertIndex(r, lines() - 1);
+        if (r == 0) {
+            return 0;
+        }
+        return rope_t::findNewLine(root.get(), r - 1) + 1;
+    }
+
+    size_t line_length(size_t r) const {
+        assertIndex(r, lines() - 1);
+        if (r + 1 == lines()) {
+            return size() - line_start(r);
+        }
+        return line_start(r + 1) - line_start(r);
+    }
+
+    size_t char_to_line(size_t i) const {
+        assertIndex(i);
+        if (i == 0) {
+            return 0;
+        }
+        assertStrictIndex(i);
+        return rope_t::newLinesBefore(root.get(), i);
+    }
+
+protected:
+    Ptr root;
+};
+
+/**
+ * Root handed from the editing thread to readers, store and load may run on different threads at the same time.
+ * Copies load the root of the original, so the backends holding one stay copyable.
+ */
+template<size_t ChunkCapacity>
+class PublishedText {
+public:
+    using Ptr = typename persistent::Rope<ChunkCapacity>::Ptr;
+
+    explicit PublishedText(Ptr root = nullptr) : _root(std::move(root)) {
+    }
+
+    PublishedText(const PublishedText &other) : _root(other.load()) {
+    }
+
+    PublishedText &operator=(const PublishedText &other) {
+        store(other.load());
+        return *this;
+    }
+
+    void store(Ptr root) {
+        _root.store(std::move(root), std::memory_order_release);
+    }
+
+    Ptr load() const {
+        return _root.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<Ptr> _root;
+};
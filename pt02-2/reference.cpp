@@ -54,6 +54,11 @@ struct TextEditorBackend {
         s.insert(i, 1, c);
     }
 
+    void insert(size_t i, std::string_view text) {
+        assertIndex(i);
+        s.insert(i, text);
+    }
+
     void erase(size_t i) {
         assertStrictIndex(i);
         s.erase(i, 1);
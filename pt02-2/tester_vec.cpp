@@ -19,12 +19,19 @@
 #include <queue>
 #include <random>
 #include <type_traits>
+#include <cstring>
+#include <string_view>
+#include <span>
+#include <atomic>
+#include <thread>
 
 #endif
 
 #define __PROGTEST__
 
 #include "main.cpp"
+#include "versioned_backend.hpp"
+#include "hybrid_backend.hpp"
 
 #undef __PROGTEST__
 
@@ -434,13 +441,14 @@ return;\
 
 #define CHECK_OP(expr, ctx) CHECK_OP_(expr, #expr,ctx)
 
-void print(const TextEditorBackend &t) {
+void print(const auto &t) {
     std::string s = text(t);
     std::replace(s.begin(), s.end(), '\n', '*');
 //    std::cout << s << std::endl;
 }
 
-void insert(int &ok, X &fail, TextEditorBackend &sol, reference::TextEditorBackend &ref) {
+template<typename Backend>
+void insert(int &ok, X &fail, Backend &sol, reference::TextEditorBackend &ref) {
     int pos = rngPos(ref.size(), 20);
     char c = rngChar();
     CHECK_OP(insert(pos, c), " (" + std::to_string(pos) + ", " + quote(c) + ")")
@@ -448,14 +456,16 @@ void insert(int &ok, X &fail, TextEditorBackend &sol, reference::TextEditorBacke
     TEST_ALL()
 }
 
-void erase(int &ok, X &fail, TextEditorBackend &sol, reference::TextEditorBackend &ref) {
+template<typename Backend>
+void erase(int &ok, X &fail, Backend &sol, reference::TextEditorBackend &ref) {
     int pos = rngPos(ref.size(), 20);
     CHECK_OP(erase(pos), " (" + std::to_string(pos) + ")")
     print(sol);
     TEST_ALL()
 }
 
-void edit(int &ok, X &fail, TextEditorBackend &sol, reference::TextEditorBackend &ref) {
+template<typename Backend>
+void edit(int &ok, X &fail, Backend &sol, reference::TextEditorBackend &ref) {
     int pos = rngPos(ref.size(), 20);
     char c = rngChar();
     CHECK_OP(edit(pos, c), " (" + std::to_string(pos) + ", " + quote(c) + ")")
@@ -463,12 +473,11 @@ void edit(int &ok, X &fail, TextEditorBackend &sol, reference::TextEditorBackend
     TEST_ALL()
 }
 
-std::vector<std::function<void(int &, X &, TextEditorBackend &,
-                               reference::TextEditorBackend &)>> referenceOperation = {
-        insert, erase, edit
-};
-
+template<typename Backend = TextEditorBackend>
 void test_vs_ref(int &ok, X &fail) {
+    std::vector<std::function<void(int &, X &, Backend &, reference::TextEditorBackend &)>> referenceOperation = {
+            insert<Backend>, erase<Backend>, edit<Backend>
+    };
     for (int i = 0; i < 100; ++i) {
         std::string s;
         for (int j = 0; j < RNG() % 20; ++j) {
@@ -478,7 +487,7 @@ void test_vs_ref(int &ok, X &fail) {
                 s.push_back(char('a' + (RNG() % 26)));
         }
 
-        TextEditorBackend t(s);
+        Backend t(s);
         reference::TextEditorBackend t2(s);
 
         for (int j = 0; j < 100; ++j) {
@@ -487,6 +496,495 @@ void test_vs_ref(int &ok, X &fail) {
     }
 }
 
+template<typename Backend = TextEditorBackend>
+void test_ranges(int &ok, X &fail) {
+    std::string ref;
+    for (int i = 0; i < 3000; ++i) ref.push_back(rngChar());
+    Backend t(ref);
+
+    for (int j = 0; j < 300; ++j) {
+        size_t pos = RNG() % (ref.size() + 1);
+        size_t len = RNG() % (ref.size() - pos + 1);
+        switch (RNG() % 3) {
+            case 0: {
+                std::string s;
+                size_t count = RNG() % (RNG() % 4 ? 20 : 3000);
+                for (size_t k = 0; k < count; ++k) s.push_back(rngChar());
+                t.insert(pos, s);
+                ref.insert(pos, s);
+                break;
+            }
+            case 1:
+                t.erase(pos, len);
+                ref.erase(pos, len);
+                break;
+            default:
+                CHECK(t.substr(pos, len), ref.substr(pos, len));
+                // keeps the line index built, so the range edits above go through its updates
+                if (pos < ref.size())
+                    CHECK(t.char_to_line(pos), size_t(std::count(ref.begin(), ref.begin() + pos, '\n')));
+        }
+        CHECK(t.size(), ref.size());
+        CHECK(t.lines(), size_t(std::count(ref.begin(), ref.end(), '\n') + 1));
+    }
+    CHECK(text(t), ref);
+
+    reference::TextEditorBackend r(ref);
+    for (size_t l = 0; l < r.lines(); ++l) CHECK(t.line_start(l), r.line_start(l));
+    for (size_t i = 0; i < r.size(); ++i) CHECK(t.char_to_line(i), r.char_to_line(i));
+
+    CHECK_EX(t.erase(0, ref.size() + 1), std::out_of_range);
+    CHECK_EX(t.erase(ref.size() + 1, 0), std::out_of_range);
+    CHECK_EX(t.substr(ref.size(), 1), std::out_of_range);
+    CHECK_EX(t.insert(ref.size() + 1, "ab"), std::out_of_range);
+    CHECK(t.substr(ref.size(), 0), "");
+}
+
+// Two cursors typing and erasing in between plain edits and queries, the second one is invalidated by the first.
+template<typename Backend = TextEditorBackend>
+void test_cursor(int &ok, X &fail) {
+    std::string ref;
+    for (int i = 0; i < 500; ++i) ref.push_back(rngChar());
+    Backend t(ref);
+    auto a = t.cursor(ref.size() / 2);
+    auto b = t.cursor(0);
+    size_t ai = ref.size() / 2, bi = 0;
+
+    for (int j = 0; j < 20000; ++j) {
+        bi = std::min(bi, ref.size());
+        b.seek(bi);
+        switch (RNG() % 10) {
+            case 0:
+            case 1:
+            case 2:
+            case 3: {
+                char c = rngChar();
+                a.insert(c);
+                ref.insert(ref.begin() + ai++, c);
+                break;
+            }
+            case 4:
+                if (ai == 0) {
+                    CHECK_EX(a.erase_before(), std::out_of_range);
+                    break;
+                }
+                a.erase_before();
+                ref.erase(--ai, 1);
+                break;
+            case 5:
+                if (ai == ref.size()) {
+                    CHECK_EX(a.erase_after(), std::out_of_range);
+                    break;
+                }
+                CHECK(a.get(), ref[ai]);
+                a.erase_after();
+                ref.erase(ai, 1);
+                break;
+            case 6: {
+                auto delta = std::ptrdiff_t(RNG() % 21) - 10;
+                if (RNG() % 8 == 0) delta *= 100;
+                if (std::ptrdiff_t(ai) + delta < 0 || ai + delta > ref.size()) {
+                    CHECK_EX(a.move(delta), std::out_of_range);
+                    break;
+                }
+                a.move(delta);
+                ai += delta;
+                break;
+            }
+            case 7: {
+                char c = rngChar();
+                b.insert(c);
+                ref.insert(ref.begin() + bi++, c);
+                break;
+            }
+            case 8: {
+                size_t pos = RNG() % (ref.size() + 1);
+                char c = rngChar();
+                t.insert(pos, c);
+                ref.insert(ref.begin() + pos, c);
+                break;
+            }
+            default:
+                if (!ref.empty()) {
+                    size_t pos = RNG() % ref.size();
+                    CHECK(t.at(pos), ref[pos]);
+                    CHECK(t.char_to_line(pos), size_t(std::count(ref.begin(), ref.begin() + pos, '\n')));
+                }
+        }
+        ai = std::min(ai, ref.size());
+        if (a.position() > ref.size()) a.seek(ai);
+        CHECK(a.position(), ai);
+        CHECK(t.size(), ref.size());
+    }
+    CHECK(t.lines(), size_t(std::count(ref.begin(), ref.end(), '\n') + 1));
+    CHECK(text(t), ref);
+
+    Backend empty("");
+    auto c = empty.cursor(0);
+    for (char ch: std::string("ab\ncd")) c.insert(ch);
+    c.move(-2);
+    c.erase_before();
+    CHECK(text(empty), "abcd");
+    CHECK(c.position(), size_t(2));
+    CHECK(c.get(), 'c');
+    CHECK_EX(empty.cursor(5), std::out_of_range);
+}
+
+// Random batches of sorted edits, applied to the reference from the last one so the positions stay valid.
+template<typename Backend = TextEditorBackend>
+void test_apply_edits(int &ok, X &fail) {
+    std::string ref;
+    for (int i = 0; i < 3000; ++i) ref.push_back(rngChar());
+    Backend t(ref);
+    using Edit = typename Backend::Edit;
+
+    for (int j = 0; j < 300; ++j) {
+        std::vector<std::string> texts;
+        std::vector<Edit> edits;
+        size_t position = 0;
+        for (size_t count = RNG() % (RNG() % 8 ? 30 : 1000); count; --count) {
+            position += RNG() % (RNG() % 2 ? 5 : 200);
+            if (position > ref.size()) break;
+            size_t erase = RNG() % 3 ? 0 : std::min<size_t>(RNG() % (RNG() % 4 ? 3 : 2000), ref.size() - position);
+            std::string s;
+            for (size_t k = RNG() % (RNG() % 8 ? 3 : 3000); k; --k) s.push_back(rngChar());
+            texts.push_back(s);
+            edits.push_back({position, erase, {}});
+            position += erase;
+        }
+        for (size_t k = 0; k < edits.size(); ++k) edits[k].text = texts[k];
+
+        std::vector<size_t> ends;
+        size_t shift = 0;
+        for (size_t k = 0; k < edits.size(); ++k) {
+            ends.push_back(edits[k].position + shift + texts[k].size());
+            shift += texts[k].size() - edits[k].erase;
+        }
+        for (size_t k = edits.size(); k--;) ref.replace(edits[k].position, edits[k].erase, texts[k]);
+        t.apply_edits(edits);
+        for (size_t k = 0; k < edits.size(); ++k) CHECK(edits[k].position, ends[k]);
+
+        CHECK(t.size(), ref.size());
+        CHECK(t.lines(), size_t(std::count(ref.begin(), ref.end(), '\n') + 1));
+        if (!ref.empty()) {
+            size_t pos = RNG() % ref.size();
+            CHECK(t.at(pos), ref[pos]);
+            CHECK(t.char_to_line(pos), size_t(std::count(ref.begin(), ref.begin() + pos, '\n')));
+        }
+    }
+    CHECK(text(t), ref);
+
+    // every cursor types a character, then all of them erase it again
+    std::vector<Edit> typing;
+    for (size_t i = 0; i <= ref.size(); i += 7) typing.push_back({i, 0, "x"});
+    t.apply_edits(typing);
+    for (size_t k = 0; k < typing.size(); ++k) {
+        CHECK(t.at(typing[k].position - 1), 'x');
+        typing[k] = {typing[k].position - 1, 1, {}};
+    }
+    t.apply_edits(typing);
+    CHECK(text(t), ref);
+
+    Edit unsorted[] = {{5, 0, "a"}, {2, 0, "b"}};
+    CHECK_EX(t.apply_edits(unsorted), std::invalid_argument);
+    Edit overlapping[] = {{2, 3, "a"}, {4, 0, "b"}};
+    CHECK_EX(t.apply_edits(overlapping), std::invalid_argument);
+    Edit outside[] = {{ref.size(), 1, {}}};
+    CHECK_EX(t.apply_edits(outside), std::out_of_range);
+    CHECK(text(t), ref);
+
+    Backend empty("");
+    Edit first[] = {{0, 0, "ab\n"}, {0, 0, "cd"}};
+    empty.apply_edits(first);
+    CHECK(text(empty), "ab\ncd");
+    CHECK(empty.lines(), size_t(2));
+    Edit all[] = {{0, 5, {}}};
+    empty.apply_edits(all);
+    CHECK(empty.size(), size_t(0));
+    Edit nothing[] = {{0, 0, {}}, {0, 0, {}}};
+    empty.apply_edits(nothing);
+    CHECK(empty.tree.getSize(), size_t(0));
+    CHECK(empty.lines(), size_t(1));
+}
+
+template<typename Backend = TextEditorBackend>
+void test_code_points(int &ok, X &fail) {
+    const std::string pieces[] = {"a", "b", "\n", "\t", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80"};
+    auto isLead = [](char c) { return (c & 0xC0) != 0x80; };
+    std::string ref;
+    for (int i = 0; i < 2000; ++i) ref += pieces[RNG() % std::size(pieces)];
+    Backend t(ref);
+
+    for (int j = 0; j < 200; ++j) {
+        std::vector<size_t> starts;
+        for (size_t i = 0; i < ref.size(); ++i) if (isLead(ref[i])) starts.push_back(i);
+        starts.push_back(ref.size());
+        size_t cp = RNG() % starts.size();
+        if (RNG() % 3 || cp + 1 == starts.size()) {
+            const std::string &piece = pieces[RNG() % std::size(pieces)];
+            t.insert(starts[cp], piece);
+            ref.insert(starts[cp], piece);
+        } else {
+            t.erase(starts[cp], starts[cp + 1] - starts[cp]);
+            ref.erase(starts[cp], starts[cp + 1] - starts[cp]);
+        }
+    }
+    CHECK(text(t), ref);
+
+    size_t cps = 0, column = 0, visual = 0, line = 0;
+    std::vector<std::vector<size_t>> lineColumns(1);
+    for (size_t i = 0; i <= ref.size(); ++i) {
+        CHECK(t.char_to_code_point(i), cps);
+        CHECK(t.char_to_column(i), column);
+        CHECK(t.char_to_visual_column(i, 8), visual);
+        if (i < ref.size() && isLead(ref[i])) CHECK(t.code_point_to_char(cps), i);
+        if (i == ref.size() || isLead(ref[i])) lineColumns[line].push_back(i);
+        if (i == ref.size()) break;
+        cps += isLead(ref[i]);
+        column += isLead(ref[i]);
+        visual += ref[i] == '\t' ? 8 : isLead(ref[i]);
+        if (ref[i] == '\n') {
+            column = visual = 0;
+            line++;
+            lineColumns.emplace_back();
+        }
+    }
+    CHECK(t.code_points(), cps);
+    CHECK(t.code_point_to_char(cps), ref.size());
+    CHECK_EX(t.code_point_to_char(cps + 1), std::out_of_range);
+    for (size_t r = 0; r < lineColumns.size(); ++r) {
+        for (size_t c = 0; c < lineColumns[r].size(); ++c) CHECK(t.line_column_to_char(r, c), lineColumns[r][c]);
+        CHECK_EX(t.line_column_to_char(r, lineColumns[r].size()), std::out_of_range);
+    }
+    CHECK_EX(t.char_to_visual_column(0, 0), std::invalid_argument);
+}
+
+void test_history(int &ok, X &fail) {
+    BasicVersionedTextEditorBackend<4> t("hello\nworld");
+    std::vector<std::string> history = {text(t)};
+    std::vector<BasicVersionedTextEditorBackend<4>::Version> handles = {t.checkpoint()};
+    CHECK(t.undo(), false);
+
+    std::string ref = history.back();
+    for (int step = 0; step < 200; ++step) {
+        for (int j = RNG() % 5; j >= 0; --j) {
+            size_t pos = RNG() % (ref.size() + 1);
+            if (RNG() % 3 || ref.empty()) {
+                char c = rngChar();
+                t.insert(pos, c);
+                ref.insert(pos, 1, c);
+            } else {
+                pos = std::min(pos, ref.size() - 1);
+                t.erase(pos);
+                ref.erase(pos, 1);
+            }
+        }
+        handles.push_back(t.checkpoint());
+        history.push_back(ref);
+    }
+
+    // walk all the way back and forth, every version has to match the copy taken at its checkpoint
+    for (size_t v = history.size() - 1; v-- > 0;) {
+        CHECK(t.undo(), true);
+        CHECK(text(t), history[v]);
+    }
+    CHECK(t.undo(), false);
+    for (size_t v = 1; v < history.size(); ++v) {
+        CHECK(t.redo(), true);
+        CHECK(text(t), history[v]);
+        CHECK(t.lines(), size_t(std::count(history[v].begin(), history[v].end(), '\n') + 1));
+    }
+    CHECK(t.redo(), false);
+
+    t.restore(handles[50]);
+    CHECK(text(t), history[50]);
+    t.insert(0, 'x');
+    CHECK(t.undo(), true);
+    CHECK(text(t), history[50]);
+    CHECK(t.redo(), true);
+    CHECK(text(t), "x" + history[50]);
+    // the edit after restore started a new branch, the old future is gone
+    CHECK(t.redo(), false);
+    CHECK_EX(t.restore(handles[100]), std::out_of_range);
+    // undo() checkpointed the branch into the slot handles[51] used to name, the old handle must not restore it
+    CHECK_EX(t.restore(handles[51]), std::out_of_range);
+    CHECK(text(t), "x" + history[50]);
+    auto branch = t.checkpoint();
+    t.restore(handles[50]);
+    CHECK(text(t), history[50]);
+    t.restore(branch);
+    CHECK(text(t), "x" + history[50]);
+}
+
+// Runs edit() while four threads keep checking that the lines of t.published() add up, returns how many did not.
+template<typename Backend>
+size_t read_while_editing(const Backend &t, const std::function<void()> &edit) {
+    std::atomic<bool> done = false;
+    std::atomic<size_t> reads = 0, broken = 0;
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 4; ++r) {
+        readers.emplace_back([&, seed = r] {
+            std::mt19937 rng(seed);
+            while (!done || reads < 1000) {
+                auto s = t.published();
+                size_t line = rng() % s.lines();
+                size_t start = s.line_start(line);
+                bool ok = start == 0 || s.at(start - 1) == '\n';
+                ok = ok && start + s.line_length(line) <= s.size();
+                if (start < s.size()) ok = ok && s.char_to_line(start) == line;
+                broken += !ok;
+                reads++;
+            }
+        });
+    }
+    edit();
+    done = true;
+    for (auto &reader: readers) reader.join();
+    return broken;
+}
+
+// Readers on other threads keep querying the latest published text while it is being edited, every snapshot has to
+// stay exactly as it was when taken.
+void test_snapshots(int &ok, X &fail) {
+    BasicVersionedTextEditorBackend<4> t("hello\nworld");
+    auto first = t.snapshot();
+    t.insert(0, 'x');
+    t.erase(6);
+    CHECK(text(first), "hello\nworld");
+    CHECK(first.lines(), size_t(2));
+    CHECK(text(t), "xhelloworld");
+    CHECK(text(t.published()), "hello\nworld");
+    CHECK_EX(first.at(11), std::out_of_range);
+
+    std::string ref = text(t);
+    std::vector<std::pair<BasicTextSnapshot<4>, std::string>> taken;
+    size_t broken = read_while_editing(t, [&] {
+        for (int step = 0; step < 3000; ++step) {
+            size_t pos = RNG() % (ref.size() + 1);
+            if (RNG() % 3 || ref.empty()) {
+                char c = rngChar();
+                t.insert(pos, c);
+                ref.insert(pos, 1, c);
+            } else {
+                pos = std::min(pos, ref.size() - 1);
+                t.erase(pos);
+                ref.erase(pos, 1);
+            }
+            t.publish();
+            if (step % 100 == 0) taken.emplace_back(t.snapshot(), ref);
+        }
+    });
+
+    CHECK(broken, size_t(0));
+    for (auto &[snapshot, expected]: taken) CHECK(text(snapshot), expected);
+    CHECK(text(t.published()), ref);
+
+    // copies share the history and the published text but edit on their own
+    auto copy = t;
+    copy.checkpoint();
+    copy.insert(0, 'y');
+    CHECK(text(t), ref);
+    CHECK(text(copy), "y" + ref);
+    CHECK(text(copy.published()), ref);
+    copy.publish();
+    CHECK(text(t.published()), ref);
+    CHECK(copy.undo(), true);
+    CHECK(text(copy), ref);
+    auto moved = std::move(copy);
+    CHECK(text(moved.published()), "y" + ref);
+    moved = t;
+    CHECK(text(moved.published()), ref);
+}
+
+// The same on the live rope, edited by every kind of edit including cursors and batches.
+template<typename Backend = TextEditorBackend>
+void test_live_snapshots(int &ok, X &fail) {
+    Backend t("hello\nworld");
+    CHECK(text(t.published()), "");
+    auto first = t.snapshot();
+    t.insert(0, 'x');
+    t.erase(6);
+    t.edit(1, 'H');
+    t.insert(3, "--\n--");
+    t.erase(0, 2);
+    CHECK(text(first), "hello\nworld");
+    CHECK(text(t.snapshot()), text(t));
+    t.publish();
+    CHECK(text(t.published()), text(t));
+
+    // edits next to each other are queued as one, a snapshot after any number of them has to see all of them
+    std::string ref = text(t);
+    size_t around = 0;
+    for (int step = 0; step < 3000; ++step) {
+        size_t drift = RNG() % 5;
+        around = std::min(ref.size(), around + drift >= 2 ? around + drift - 2 : 0);
+        size_t len = std::min<size_t>(RNG() % 3, ref.size() - around);
+        std::string s(RNG() % 3, rngChar());
+        t.erase(around, len);
+        t.insert(around, s);
+        ref.replace(around, len, s);
+        if (RNG() % 10 == 0) CHECK(text(t.snapshot()), ref);
+    }
+    CHECK(text(t.snapshot()), ref);
+
+    std::vector<std::pair<typename Backend::snapshot_t, std::string>> taken;
+    auto cursor = t.cursor(0);
+    size_t broken = read_while_editing(t, [&] {
+        for (int step = 0; step < 3000; ++step) {
+            size_t pos = RNG() % (ref.size() + 1);
+            switch (RNG() % 6) {
+                case 0: {
+                    std::string s;
+                    for (size_t k = RNG() % 20; k; --k) s.push_back(rngChar());
+                    t.insert(pos, s);
+                    ref.insert(pos, s);
+                    break;
+                }
+                case 1: {
+                    size_t len = std::min<size_t>(RNG() % 20, ref.size() - pos);
+                    t.erase(pos, len);
+                    ref.erase(pos, len);
+                    break;
+                }
+                case 2: {
+                    cursor.seek(pos);
+                    for (size_t k = RNG() % 10; k; --k) {
+                        char c = rngChar();
+                        cursor.insert(c);
+                        ref.insert(cursor.position() - 1, 1, c);
+                    }
+                    if (cursor.position()) {
+                        cursor.erase_before();
+                        ref.erase(cursor.position(), 1);
+                    }
+                    break;
+                }
+                case 3: {
+                    typename Backend::Edit edits[] = {{pos / 2, 0, "ab"}, {pos, size_t(pos < ref.size()), "\n"}};
+                    ref.replace(edits[1].position, edits[1].erase, "\n");
+                    ref.insert(edits[0].position, "ab");
+                    t.apply_edits(edits);
+                    break;
+                }
+                default:
+                    if (pos < ref.size()) {
+                        char c = rngChar();
+                        t.edit(pos, c);
+                        ref[pos] = c;
+                    }
+            }
+            t.publish();
+            if (step % 100 == 0) taken.emplace_back(t.snapshot(), ref);
+        }
+    });
+
+    CHECK(broken, size_t(0));
+    CHECK(text(t), ref);
+    CHECK(text(t.snapshot()), ref);
+    CHECK(text(first), "hello\nworld");
+    for (auto &[snapshot, expected]: taken) CHECK(text(snapshot), expected);
+}
+
 void test4(int &ok, X &fail) {
     TextEditorBackend t("");
     CHECK(text(t), "");
@@ -532,13 +1030,66 @@ void test4(int &ok, X &fail) {
     CHECK_ALL(t.char_to_line, 0);
 }
 
+// Growing past the limit moves the text into the rope, it comes back only below a quarter of the limit.
+void test_hybrid(int &ok, X &fail) {
+    BasicHybridTextEditorBackend<64, 4> t("ab\ncd");
+    std::string ref = "ab\ncd";
+    CHECK(t.small(), true);
+    std::string block = "0123456789\n";
+    for (int i = 0; i < 6; ++i) {
+        t.insert(3, block);
+        ref.insert(3, block);
+    }
+    CHECK(t.small(), false);
+    CHECK(text(t), ref);
+    CHECK(t.rope()->size(), ref.size());
+    t.erase(0, 40);
+    ref.erase(0, 40);
+    CHECK(t.small(), false);
+    CHECK(t.lines(), size_t(std::count(ref.begin(), ref.end(), '\n') + 1));
+    while (ref.size() >= 16) {
+        t.erase(ref.size() - 1);
+        ref.pop_back();
+    }
+    CHECK(t.small(), true);
+    CHECK(text(t), ref);
+    CHECK(t.rope() == nullptr, true);
+    CHECK(t.gapBuffer().capacity() >= ref.size(), true);
+    reference::TextEditorBackend r(ref);
+    for (size_t l = 0; l < r.lines(); ++l) CHECK(t.line_start(l), r.line_start(l));
+    for (size_t l = 0; l < r.lines(); ++l) CHECK(t.line_length(l), r.line_length(l));
+    CHECK_EX(t.erase(ref.size()), std::out_of_range);
+    CHECK_EX(t.insert(ref.size() + 1, 'x'), std::out_of_range);
+}
+
 std::vector<std::function<void(int &, X &)>> tests = {
         test1,
         test2,
         test3,
         test4,
         test_ex,
-        test_vs_ref
+        test_vs_ref<>,
+        // tiny chunks so the random edits keep splitting and merging them
+        test_vs_ref<BasicTextEditorBackend<4>>,
+        test_ranges<>,
+        test_ranges<BasicTextEditorBackend<4>>,
+        test_vs_ref<VersionedTextEditorBackend>,
+        test_vs_ref<BasicVersionedTextEditorBackend<4>>,
+        test_vs_ref<HybridTextEditorBackend>,
+        // a limit the random edits keep crossing both ways, with tiny rope chunks once it is large
+        test_vs_ref<BasicHybridTextEditorBackend<16, 4>>,
+        test_ranges<BasicHybridTextEditorBackend<1024, 4>>,
+        test_hybrid,
+        test_history,
+        test_snapshots,
+        test_live_snapshots<BasicTextEditorBackend<4>>,
+        test_live_snapshots<>,
+        test_code_points<>,
+        test_code_points<BasicTextEditorBackend<4>>,
+        test_cursor<>,
+        test_cursor<BasicTextEditorBackend<4>>,
+        test_apply_edits<>,
+        test_apply_edits<BasicTextEditorBackend<4>>
 };
 
 int main() {
@@ -0,0 +1,339 @@
+#include <benchmark/benchmark.h>
+#include <malloc.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "main.cpp"
+#include "hybrid_backend.hpp"
+
+// The std::string backend tester_vec checks against, in its own namespace next to the rope one.
+namespace reference {
+#include "reference.cpp"
+}
+
+// Replays edit traces on the rope TextEditorBackend, the HybridTextEditorBackend and the reference std::string backend.
+//
+// Every run reports the time per operation, peak_heap (the most heap the backend held at once from its construction
+// to the end of the replay, counted by the operator new below) and the memory the text holds after the replay,
+// nodes is the number of rope chunks.
+// EDIT_TRACE=path adds a recorded trace, one operation per line:
+//     i <position> <character code>    insert
+//     e <position>                     erase
+//     p <position> <text>              paste, the text runs till the end of the line
+//     l <row>                          line_start
+//     c <position>                     char_to_line
+// The text it starts from is read from EDIT_TRACE_TEXT when set, it is empty otherwise.
+
+// Live heap bytes, only the benchmark thread allocates while a replay is measured.
+// The replaced operators go through allocate and release, which are never inlined: GCC would otherwise see malloc
+// behind operator new and warn (-Wmismatched-new-delete) at every delete of what it returned.
+namespace heap {
+    size_t live = 0, peak = 0;
+
+    // alignment 0 is plain malloc
+    [[gnu::noinline]] void *allocate(size_t size, size_t alignment = 0) {
+        // aligned_alloc wants a nonzero multiple of the alignment
+        void *p = alignment
+                  ? std::aligned_alloc(alignment, std::max(alignment, (size + alignment - 1) & ~(alignment - 1)))
+                  : std::malloc(size ? size : 1);
+        if (!p) throw std::bad_alloc();
+        live += malloc_usable_size(p);
+        peak = std::max(peak, live);
+        return p;
+    }
+
+    [[gnu::noinline]] void release(void *p) noexcept {
+        if (p) live -= malloc_usable_size(p);
+        std::free(p);
+    }
+}
+
+void *operator new(size_t size) {
+    return heap::allocate(size);
+}
+
+void *operator new(size_t size, std::align_val_t align) {
+    return heap::allocate(size, size_t(align));
+}
+
+void operator delete(void *p) noexcept {
+    heap::release(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    heap::release(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    heap::release(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    heap::release(p);
+}
+
+struct Edit {
+    enum class Kind {
+        insert, erase, paste, line_start, char_to_line
+    };
+
+    Kind kind;
+    size_t position;
+    char c = 0;
+    std::string text;
+};
+
+struct Trace {
+    std::string initial;
+    std::vector<Edit> edits;
+};
+
+static std::string source_text(size_t size) {
+    std::mt19937 rng(12345);
+    std::string text(size, 'a');
+    for (size_t i = 0; i < size; ++i) {
+        if (rng() % 60 == 0) text[i] = '\n';
+        else text[i] = char('a' + rng() % 26);
+    }
+    return text;
+}
+
+// Traces are generated against the rope itself, so every position is valid at the moment it is replayed.
+struct TraceBuilder {
+    Trace trace;
+    TextEditorBackend text;
+    std::mt19937 rng{12345};
+
+    explicit TraceBuilder(size_t size) : trace{source_text(size), {}}, text(trace.initial) {}
+
+    size_t random(size_t bound) {
+        return bound ? rng() % bound : 0;
+    }
+
+    void insert(size_t position, char c) {
+        text.insert(position, c);
+        trace.edits.push_back({Edit::Kind::insert, position, c, {}});
+    }
+
+    void erase(size_t position) {
+        text.erase(position);
+        trace.edits.push_back({Edit::Kind::erase, position, 0, {}});
+    }
+
+    void paste(size_t position, std::string block) {
+        text.insert(position, block);
+        trace.edits.push_back({Edit::Kind::paste, position, 0, std::move(block)});
+    }
+
+    void query() {
+        if (rng() % 2) trace.edits.push_back({Edit::Kind::line_start, random(text.lines()), 0, {}});
+        else trace.edits.push_back({Edit::Kind::char_to_line, random(text.size() + 1), 0, {}});
+    }
+};
+
+// Bursts of typing at a random place, a newline every so often and a backspace every 7th keystroke.
+static Trace typing_trace(size_t size) {
+    TraceBuilder builder(size);
+    while (builder.trace.edits.size() < 20'000) {
+        size_t position = builder.random(builder.text.size() + 1);
+        for (size_t burst = 20 + builder.random(200); burst; --burst) {
+            builder.insert(position++, builder.random(40) ? char('a' + builder.random(26)) : '\n');
+            if (builder.random(7) == 0) builder.erase(--position);
+        }
+    }
+    return std::move(builder.trace);
+}
+
+// Single characters inserted and erased anywhere.
+static Trace random_trace() {
+    TraceBuilder builder(1 << 20);
+    while (builder.trace.edits.size() < 20'000) {
+        if (builder.random(2)) builder.insert(builder.random(builder.text.size() + 1), char('a' + builder.random(26)));
+        else builder.erase(builder.random(builder.text.size()));
+    }
+    return std::move(builder.trace);
+}
+
+// Navigation, line queries with an occasional keystroke between them.
+static Trace lines_trace() {
+    TraceBuilder builder(1 << 20);
+    while (builder.trace.edits.size() < 2'000) {
+        builder.query();
+        if (builder.random(10) == 0) builder.insert(builder.random(builder.text.size() + 1), 'x');
+    }
+    return std::move(builder.trace);
+}
+
+// Large blocks pasted and a line query after each of them.
+static Trace paste_trace() {
+    TraceBuilder builder(1 << 20);
+    std::string block = source_text(64 << 10);
+    while (builder.trace.edits.size() < 200) {
+        size_t from = builder.random(block.size());
+        size_t length = 1 + builder.random(block.size() - from);
+        builder.paste(builder.random(builder.text.size() + 1), block.substr(from, length));
+        builder.query();
+    }
+    return std::move(builder.trace);
+}
+
+static Trace recorded_trace(const char *path, const char *textPath) {
+    Trace trace;
+    if (textPath) {
+        std::ifstream input(textPath, std::ios::binary);
+        trace.initial.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    std::ifstream input(path);
+    std::string line;
+    while (std::getline(input, line)) {
+        std::istringstream fields(line);
+        char kind = 0;
+        size_t position = 0;
+        if (!(fields >> kind >> position)) continue;
+        switch (kind) {
+            case 'i': {
+                int c = 0;
+                fields >> c;
+                trace.edits.push_back({Edit::Kind::insert, position, char(c), {}});
+                break;
+            }
+            case 'e':
+                trace.edits.push_back({Edit::Kind::erase, position, 0, {}});
+                break;
+            case 'p': {
+                fields.get();
+                std::string text;
+                std::getline(fields, text);
+                trace.edits.push_back({Edit::Kind::paste, position, 0, std::move(text)});
+                break;
+            }
+            case 'l':
+                trace.edits.push_back({Edit::Kind::line_start, position, 0, {}});
+                break;
+            case 'c':
+                trace.edits.push_back({Edit::Kind::char_to_line, position, 0, {}});
+                break;
+            default:
+                throw std::invalid_argument("Unknown edit '" + std::string(1, kind) + "' in " + path);
+        }
+    }
+    return trace;
+}
+
+template<typename Backend>
+static size_t replay(Backend &text, const Trace &trace) {
+    size_t sink = 0;
+    for (const Edit &edit: trace.edits) {
+        switch (edit.kind) {
+            case Edit::Kind::insert:
+                text.insert(edit.position, edit.c);
+                break;
+            case Edit::Kind::erase:
+                text.erase(edit.position);
+                break;
+            case Edit::Kind::paste:
+                text.insert(edit.position, std::string_view(edit.text));
+                break;
+            case Edit::Kind::line_start:
+                sink += text.line_start(edit.position);
+                break;
+            case Edit::Kind::char_to_line:
+                sink += text.char_to_line(edit.position);
+                break;
+        }
+    }
+    return sink;
+}
+
+static size_t heap_bytes(const TextEditorBackend &text) {
+    return text.tree.getSize() * sizeof(TextEditorBackend::NodeType);
+}
+
+static size_t heap_bytes(const HybridTextEditorBackend &text) {
+    return text.small() ? text.gapBuffer().capacity() : heap_bytes(*text.rope());
+}
+
+static size_t heap_bytes(const reference::TextEditorBackend &text) {
+    return text.s.capacity();
+}
+
+// Rope chunks, 0 for the backends keeping the text in one array.
+static size_t nodes(const TextEditorBackend &text) {
+    return text.tree.getSize();
+}
+
+static size_t nodes(const HybridTextEditorBackend &text) {
+    return text.small() ? 0 : nodes(*text.rope());
+}
+
+static size_t nodes(const reference::TextEditorBackend &) {
+    return 0;
+}
+
+template<typename Backend>
+static void replay_trace(benchmark::State &state, const Trace &trace) {
+    size_t bytes = 0, chunks = 0, peak = 0;
+    for (auto _: state) {
+        state.PauseTiming();
+        size_t before = heap::live;
+        heap::peak = before;
+        auto text = std::make_unique<Backend>(trace.initial);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(replay(*text, trace));
+        state.PauseTiming();
+        peak = heap::peak - before;
+        bytes = heap_bytes(*text);
+        chunks = nodes(*text);
+        text = nullptr;
+        state.ResumeTiming();
+    }
+    auto operations = double(trace.edits.size());
+    state.counters["time/op"] = benchmark::Counter(operations, benchmark::Counter::kIsIterationInvariantRate |
+                                                               benchmark::Counter::kInvert);
+    state.counters["peak_heap"] = benchmark::Counter(double(peak), benchmark::Counter::kDefaults,
+                                                     benchmark::Counter::kIs1024);
+    state.counters["text_bytes"] = benchmark::Counter(double(bytes), benchmark::Counter::kDefaults,
+                                                      benchmark::Counter::kIs1024);
+    state.counters["nodes"] = double(chunks);
+    state.SetItemsProcessed(int64_t(state.iterations() * trace.edits.size()));
+}
+
+template<typename Backend>
+static void register_trace(const std::string &backend, const std::string &name, const Trace &trace) {
+    benchmark::RegisterBenchmark((backend + "/" + name).c_str(), [&trace](benchmark::State &state) {
+        replay_trace<Backend>(state, trace);
+    })->Unit(benchmark::kMillisecond);
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::pair<std::string, Trace>> traces;
+    traces.emplace_back("typing", typing_trace(1 << 20));
+    // A short file, where moving the tail of one string is cheap.
+    traces.emplace_back("typing_4k", typing_trace(4 << 10));
+    traces.emplace_back("random", random_trace());
+    traces.emplace_back("lines", lines_trace());
+    traces.emplace_back("paste", paste_trace());
+    if (const char *path = std::getenv("EDIT_TRACE"))
+        traces.emplace_back("recorded", recorded_trace(path, std::getenv("EDIT_TRACE_TEXT")));
+
+    for (const auto &[name, trace]: traces) {
+        register_trace<TextEditorBackend>("rope", name, trace);
+        register_trace<HybridTextEditorBackend>("hybrid", name, trace);
+        register_trace<reference::TextEditorBackend>("reference", name, trace);
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "persistent_rope.hpp"
+
+/**
+ * TextEditorBackend with history. Every state is an immutable persistent::Rope root, checkpoint() records the current
+ * one and undo()/redo()/restore() just swap roots, each kept version costs O(log n) nodes over the previous one.
+ * The same sharing gives snapshot() in O(1) for readers on other threads, see BasicTextSnapshot.
+ */
+template<size_t ChunkCapacity>
+struct BasicVersionedTextEditorBackend : BasicTextSnapshot<ChunkCapacity> {
+    using snapshot_t = BasicTextSnapshot<ChunkCapacity>;
+    using typename snapshot_t::rope_t;
+    using typename snapshot_t::Ptr;
+    using snapshot_t::root;
+    using snapshot_t::assertIndex;
+    using snapshot_t::assertStrictIndex;
+
+    // Slot in the history and the generation it was recorded under, a slot reused after undo gets a new one.
+    struct Version {
+        size_t id;
+        size_t generation;
+    };
+
+    BasicVersionedTextEditorBackend(const std::string &text) : snapshot_t(rope_t::build(text)), versions{{root, 0}} {
+    }
+
+    void edit(size_t i, char c) {
+        assertStrictIndex(i);
+        root = rope_t::set(root, i, c);
+    }
+
+    void insert(size_t i, char c) {
+        assertIndex(i);
+        root = rope_t::insert(root, i, std::string_view(&c, 1));
+    }
+
+    void erase(size_t i) {
+        assertStrictIndex(i);
+        root = rope_t::erase(root, i);
+    }
+
+    // The current text, O(1). Edits made afterwards do not show in it.
+    snapshot_t snapshot() const {
+        return snapshot_t(root);
+    }
+
+    // Makes the current text the one published() returns, for readers which pick up the latest state on their own
+    // instead of being handed a snapshot. Safe to call while other threads call published().
+    void publish() {
+        latest.store(root);
+    }
+
+    snapshot_t published() const {
+        return snapshot_t(latest.load());
+    }
+
+    // Records the current text as a new version, versions which were undone are dropped.
+    Version checkpoint() {
+        if (root != versions[current].root) {
+            versions.resize(current + 1);
+            versions.push_back({root, ++generations});
+            current++;
+        }
+        return {current, versions[current].generation};
+    }
+
+    // Goes back to the previous version, uncommitted edits are checkpointed first so redo() brings them back.
+    bool undo() {
+        checkpoint();
+        if (current == 0) {
+            return false;
+        }
+        root = versions[--current].root;
+        return true;
+    }
+
+    bool redo() {
+        if (root != versions[current].root || current + 1 == versions.size()) {
+            return false;
+        }
+        root = versions[++current].root;
+        return true;
+    }
+
+    void restore(Version version) {
+        if (version.id >= versions.size() || versions[version.id].generation != version.generation) {
+            throw std::out_of_range("Version " + std::to_string(version.id) + " is not in the history");
+        }
+        current = version.id;
+        root = versions[current].root;
+    }
+
+private:
+    struct Entry {
+        Ptr root;
+        size_t generation;
+    };
+
+    std::vector<Entry> versions;
+    size_t current = 0;
+    size_t generations = 0;
+    PublishedText<ChunkCapacity> latest{root};
+};
+
+using VersionedTextEditorBackend = BasicVersionedTextEditorBackend<256>;
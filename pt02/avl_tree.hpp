@@ -1,14 +1,33 @@
+#pragma once
+
 #include <algorithm>
 #include <memory>
 #include <optional>
 #include <iterator>
 #include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <compare>
+#include <limits>
+
+#if __has_include(<sys/mman.h>)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define AVL_TREE_MMAP 1
+#endif
 
 #ifdef AVL_TREE_TESTING
 
 #include <cassert>
 #include <sstream>
-#include <fstream>
 
 #endif
 
@@ -28,17 +47,86 @@ namespace stl {
         }
     }
 
+    /**
+     * On disk layout written by AVLTree::save:
+     *  header | sorted key block | optional eytzinger layout (keys in BFS order + their sorted ranks)
+     * Every block starts at a multiple of avl_file_header::alignment so it can be used straight from the mapping.
+     */
+    struct avl_file_header {
+        static constexpr char expected_magic[8] = {'A', 'V', 'L', 'T', 'R', 'E', 'E', '\0'};
+        static constexpr uint32_t current_version = 1;
+        static constexpr uint64_t alignment = 64;
+
+        char magic[8];
+        uint32_t version;
+        uint32_t value_size;
+        uint64_t count;
+        uint64_t keys_offset;
+        // 0 when the file has no precomputed layout
+        uint64_t layout_offset;
+        uint64_t ranks_offset;
+
+        static uint64_t align(uint64_t offset) {
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+    };
+
+    /**
+     * Monoids usable as the Aggregate parameter of AVLTree. A monoid provides the aggregate value_type, an
+     * associative combine(a, b), its identity() and lift(value) turning a stored value into an aggregate.
+     * no_aggregate disables the augmentation, nodes then carry no extra data.
+     */
+    namespace monoid {
+        struct no_aggregate {
+            struct value_type {
+            };
+        };
+
+        template<typename T>
+        struct sum {
+            using value_type = T;
+
+            static value_type identity() { return T{}; }
+
+            static value_type lift(const T & value) { return value; }
+
+            static value_type combine(const value_type & a, const value_type & b) { return a + b; }
+        };
+
+        template<typename T>
+        struct min {
+            using value_type = T;
+
+            static value_type identity() { return std::numeric_limits<T>::max(); }
+
+            static value_type lift(const T & value) { return value; }
+
+            static value_type combine(const value_type & a, const value_type & b) { return std::min(a, b); }
+        };
+
+        template<typename T>
+        struct max {
+            using value_type = T;
+
+            static value_type identity() { return std::numeric_limits<T>::lowest(); }
+
+            static value_type lift(const T & value) { return value; }
+
+            static value_type combine(const value_type & a, const value_type & b) { return std::max(a, b); }
+        };
+    }
+
 
 #if __cplusplus >= 202002L
 
-    template<typename T, typename Compare=std::compare_three_way> // TODO: default back to less if not possible to use three way
+    template<typename T, typename Compare=std::conditional_t<std::three_way_comparable<T>, std::compare_three_way, std::less<T>>, typename Aggregate=monoid::no_aggregate>
 #else
 
-    template<typename T, typename Compare=std::less<T>>
+    template<typename T, typename Compare=std::less<T>, typename Aggregate=monoid::no_aggregate>
 #endif
     class AVLTree {
 
-        using self = AVLTree<T, Compare>;
+        using self = AVLTree<T, Compare, Aggregate>;
         template<typename TypePointer>
         struct avl_iterator;
 
@@ -63,6 +151,10 @@ namespace stl {
         using size_type = size_t;
         using difference_type = long long int;
         using value_compare = Compare;
+        using aggregate_monoid = Aggregate;
+        using aggregate_type = typename Aggregate::value_type;
+
+        static constexpr bool has_aggregate = !std::is_same_v<Aggregate, monoid::no_aggregate>;
 
         using descendant_ptr = std::unique_ptr<Node> self::Node::*;
       private:
@@ -154,6 +246,8 @@ namespace stl {
                     right->parent = this;
                 }
                 copyData(other);
+                count = other.count;
+                aggregate = other.aggregate;
                 return *this;
             }
 
@@ -170,6 +264,8 @@ namespace stl {
                     right = std::unique_ptr<Node>(std::move(other.right));
                     right->parent = this;
                 }
+                count = other.count;
+                aggregate = other.aggregate;
                 if (!other.is_real) {
                     clear();
                     return *this;
@@ -192,6 +288,18 @@ namespace stl {
                 }
             }
 
+            static aggregate_type aggregateOf(const sus_ptr<const Node> node) {
+                if (node) return node->aggregate;
+                return Aggregate::identity();
+            }
+
+            void updateAggregate() {
+                if constexpr (has_aggregate) {
+                    aggregate = Aggregate::combine(Aggregate::combine(aggregateOf(left.get()), Aggregate::lift(*data)),
+                                                   aggregateOf(right.get()));
+                }
+            }
+
             difference_type sign() const {
                 difference_type sign = 0;
                 if (left) sign -= left->maxDepth;
@@ -246,6 +354,7 @@ namespace stl {
             std::unique_ptr<Node> right = nullptr;
             difference_type maxDepth = 1;
             size_type count = 0;
+            [[no_unique_address]] aggregate_type aggregate = {};
             bool is_real = false;
 
 
@@ -444,6 +553,7 @@ namespace stl {
             root = header->left.get();
             root->parent = header.get();
             root->count = 1;
+            root->updateAggregate();
             return root;
         }
 
@@ -546,6 +656,8 @@ namespace stl {
              */
             pivotRaw->updateMaxDepth();
             rightSub->updateMaxDepth();
+            pivotRaw->updateAggregate();
+            rightSub->updateAggregate();
 
             pivotRaw->count -= 1;
             if (rightSub.get()->*right) pivotRaw->count -= (rightSub.get()->*right)->count;
@@ -635,6 +747,9 @@ namespace stl {
                     child->parent = parent;
                 }
                 parent->*direction = std::move(child);
+                for (sus_ptr<Node> ancestor = parent; ancestor->is_real; ancestor = ancestor->parent) {
+                    ancestor->updateAggregate();
+                }
                 if (!parent->is_real) {
                     root = parent->left.get();
                 } else {
@@ -649,6 +764,48 @@ namespace stl {
             }
         }
 
+        static bool value_less(const value_compare & comparator, const value_type & a, const value_type & b) {
+#if __cplusplus >= 202002L
+            if constexpr (std::is_convertible_v<std::invoke_result_t<value_compare, value_type, value_type>, std::weak_ordering>) {
+                return comparator(a, b) < 0;
+            } else {
+                return comparator(a, b);
+            }
+#else
+            return comparator(a, b);
+#endif
+        }
+
+        // Fills ranks[bfs index] with the in order position of that node of a complete tree with ranks.size() nodes.
+        uint64_t eytzinger_ranks(std::vector<uint64_t> & ranks, uint64_t next, uint64_t index) const {
+            if (index > ranks.size()) return next;
+            next = eytzinger_ranks(ranks, next, 2 * index);
+            ranks[index - 1] = next++;
+            return eytzinger_ranks(ranks, next, 2 * index + 1);
+        }
+
+        template<typename Iterator>
+        std::unique_ptr<Node> buildSubtree(Iterator first, size_type count, sus_ptr<Node> parent) {
+            if (!count) return nullptr;
+            size_type middle = count / 2;
+            auto node = std::make_unique<Node>();
+            node->construct(*std::next(first, (difference_type) middle));
+            node->parent = parent;
+            node->left = buildSubtree(first, middle, node.get());
+            node->right = buildSubtree(std::next(first, (difference_type) middle + 1), count - middle - 1, node.get());
+            node->count = count;
+            node->updateMaxDepth();
+            node->updateAggregate();
+            return node;
+        }
+
+        // Replaces the content by the strictly increasing range [first, last) in O(n).
+        template<typename Iterator>
+        void buildSorted(Iterator first, Iterator last) {
+            header->left = buildSubtree(first, (size_type) std::distance(first, last), header.get());
+            root = header->left.get();
+        }
+
       public:
 
         AVLTree() {
@@ -700,6 +857,7 @@ namespace stl {
             sus_ptr<Node> ptr = inserted;
             while (ptr->is_real) {
                 ptr->count++;
+                ptr->updateAggregate();
                 ptr = ptr->parent;
             }
 
@@ -723,7 +881,7 @@ namespace stl {
             if (index > root->count) return end();
             sus_ptr<Node> current = root;
             while (current->leftCount() + 1 != index) {
-                if (current->count > index) {
+                if (current->leftCount() >= index) {
                     current = current->left.get();
                 } else {
                     index -= current->leftCount() + 1;
@@ -743,6 +901,248 @@ namespace stl {
             return (bool) inner_find(value);
         }
 
+        size_type size() const {
+            return root ? root->count : 0;
+        }
+
+        // Combination of all values in order, identity for an empty tree.
+        aggregate_type aggregate() const {
+            static_assert(has_aggregate, "AVLTree needs an Aggregate monoid");
+            return Node::aggregateOf(root);
+        }
+
+        /**
+         * Combination of values in [low, high) in order, in O(log n). Walks down to the topmost node inside
+         * the range and then along the two boundary paths, taking whole subtrees that are inside.
+         */
+        aggregate_type aggregate(const value_type & low, const value_type & high) const {
+            static_assert(has_aggregate, "AVLTree needs an Aggregate monoid");
+            auto less = [this](const value_type & a, const value_type & b) {
+                return value_less(comparator, a, b);
+            };
+            sus_ptr<const Node> split = root;
+            while (split && (less(split->dataRef(), low) || !less(split->dataRef(), high))) {
+                split = less(split->dataRef(), low) ? split->right.get() : split->left.get();
+            }
+            if (!split) return Aggregate::identity();
+
+            aggregate_type left = Aggregate::identity();
+            for (sus_ptr<const Node> current = split->left.get(); current;) {
+                if (!less(current->dataRef(), low)) {
+                    left = Aggregate::combine(Aggregate::combine(Aggregate::lift(current->dataRef()),
+                                                                 Node::aggregateOf(current->right.get())), left);
+                    current = current->left.get();
+                } else {
+                    current = current->right.get();
+                }
+            }
+
+            aggregate_type right = Aggregate::identity();
+            for (sus_ptr<const Node> current = split->right.get(); current;) {
+                if (less(current->dataRef(), high)) {
+                    right = Aggregate::combine(right, Aggregate::combine(Node::aggregateOf(current->left.get()),
+                                                                         Aggregate::lift(current->dataRef())));
+                    current = current->right.get();
+                } else {
+                    current = current->left.get();
+                }
+            }
+            return Aggregate::combine(Aggregate::combine(left, Aggregate::lift(split->dataRef())), right);
+        }
+
+        //<editor-fold desc="Serialization">
+        /**
+         * Writes the values in order, optionally followed by an eytzinger layout which makes lookups in
+         * open_mmap() branch free and cache friendly. Only trivially copyable values can be stored.
+         */
+        void save(const std::string & path, bool with_layout = true) const {
+            static_assert(std::is_trivially_copyable_v<value_type>, "Only trivially copyable values can be saved");
+            std::ofstream output(path, std::ios::binary | std::ios::trunc);
+            if (!output) throw std::runtime_error("Cannot open " + path + " for writing");
+
+            avl_file_header header = {};
+            std::copy(std::begin(avl_file_header::expected_magic), std::end(avl_file_header::expected_magic),
+                      header.magic);
+            header.version = avl_file_header::current_version;
+            header.value_size = sizeof(value_type);
+            header.count = size();
+            header.keys_offset = avl_file_header::align(sizeof(avl_file_header));
+            uint64_t keys_end = header.keys_offset + header.count * sizeof(value_type);
+            if (with_layout) {
+                header.layout_offset = avl_file_header::align(keys_end);
+                header.ranks_offset = avl_file_header::align(header.layout_offset + header.count * sizeof(value_type));
+            }
+
+            uint64_t written = 0;
+            auto write = [&](const void * data, uint64_t bytes) {
+                output.write(static_cast<const char *>(data), (std::streamsize) bytes);
+                written += bytes;
+            };
+            auto pad = [&](uint64_t offset) {
+                static constexpr char zeros[avl_file_header::alignment] = {};
+                write(zeros, offset - written);
+            };
+
+            write(&header, sizeof(header));
+            pad(header.keys_offset);
+            for (const_value_reference value: *this) {
+                write(&value, sizeof(value_type));
+            }
+            if (with_layout) {
+                std::vector<uint64_t> ranks(header.count);
+                eytzinger_ranks(ranks, 0, 1);
+                std::vector<sus_ptr<const value_type>> sorted;
+                sorted.reserve(header.count);
+                for (const_value_reference value: *this) sorted.push_back(&value);
+                pad(header.layout_offset);
+                for (uint64_t rank: ranks) write(sorted[rank], sizeof(value_type));
+                pad(header.ranks_offset);
+                write(ranks.data(), ranks.size() * sizeof(uint64_t));
+            }
+            if (!output) throw std::runtime_error("Failed writing " + path);
+        }
+
+#ifdef AVL_TREE_MMAP
+
+        /**
+         * Read only view over a file written by save(). Nothing is copied, lookups and iteration work directly
+         * on the mapped pages, so opening is O(1) and the page cache does the rest.
+         */
+        class mapped_tree {
+          public:
+            using const_iterator = const value_type *;
+
+            explicit mapped_tree(const std::string & path) {
+                int fd = ::open(path.c_str(), O_RDONLY);
+                if (fd < 0) throw std::runtime_error("Cannot open " + path + ": " + std::strerror(errno));
+                struct stat info = {};
+                if (fstat(fd, &info) != 0 || (size_t) info.st_size < sizeof(avl_file_header)) {
+                    ::close(fd);
+                    throw std::runtime_error(path + " is not an AVLTree file");
+                }
+                mapping_size = info.st_size;
+                void * mapped = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                ::close(fd);
+                if (mapped == MAP_FAILED) throw std::runtime_error("Cannot map " + path + ": " + std::strerror(errno));
+                mapping = static_cast<const unsigned char *>(mapped);
+
+                avl_file_header header = {};
+                std::memcpy(&header, mapping, sizeof(header));
+                if (!std::equal(std::begin(header.magic), std::end(header.magic),
+                                std::begin(avl_file_header::expected_magic)) ||
+                    header.version != avl_file_header::current_version ||
+                    header.value_size != sizeof(value_type) ||
+                    header.keys_offset + header.count * sizeof(value_type) > mapping_size ||
+                    (header.layout_offset && header.ranks_offset + header.count * sizeof(uint64_t) > mapping_size)) {
+                    unmap();
+                    throw std::runtime_error(path + " is not a compatible AVLTree file");
+                }
+                element_count = header.count;
+                keys = reinterpret_cast<const value_type *>(mapping + header.keys_offset);
+                if (header.layout_offset) {
+                    layout = reinterpret_cast<const value_type *>(mapping + header.layout_offset);
+                    ranks = reinterpret_cast<const uint64_t *>(mapping + header.ranks_offset);
+                }
+            }
+
+            mapped_tree(mapped_tree && other) noexcept {
+                *this = std::move(other);
+            }
+
+            mapped_tree & operator=(mapped_tree && other) noexcept {
+                if (&other == this) return *this;
+                unmap();
+                std::swap(mapping, other.mapping);
+                std::swap(mapping_size, other.mapping_size);
+                std::swap(element_count, other.element_count);
+                std::swap(keys, other.keys);
+                std::swap(layout, other.layout);
+                std::swap(ranks, other.ranks);
+                return *this;
+            }
+
+            mapped_tree(const mapped_tree &) = delete;
+
+            mapped_tree & operator=(const mapped_tree &) = delete;
+
+            ~mapped_tree() {
+                unmap();
+            }
+
+            const_iterator lower_bound(const value_type & value) const {
+                if (!layout) {
+                    return std::lower_bound(begin(), end(), value, [this](const value_type & a, const value_type & b) {
+                        return value_less(comparator, a, b);
+                    });
+                }
+                // branch free descent over the BFS ordered copy, the answer is the last node where we went left
+                uint64_t index = 1;
+                while (index <= element_count) {
+                    index = 2 * index + value_less(comparator, layout[index - 1], value);
+                }
+                index >>= __builtin_ffsll((long long) ~index);
+                if (!index) return end();
+                return keys + ranks[index - 1];
+            }
+
+            const_iterator find(const value_type & value) const {
+                const_iterator found = lower_bound(value);
+                if (found == end() || value_less(comparator, value, *found)) return end();
+                return found;
+            }
+
+            size_type count(const value_type & value) const {
+                return find(value) != end();
+            }
+
+            const_iterator begin() const {
+                return keys;
+            }
+
+            const_iterator end() const {
+                return keys + element_count;
+            }
+
+            size_type size() const {
+                return element_count;
+            }
+
+            bool empty() const {
+                return !element_count;
+            }
+
+          private:
+            void unmap() {
+                if (mapping) munmap(const_cast<unsigned char *>(mapping), mapping_size);
+                mapping = nullptr;
+                mapping_size = 0;
+            }
+
+            value_compare comparator = {};
+            const unsigned char * mapping = nullptr;
+            size_t mapping_size = 0;
+            size_type element_count = 0;
+            const value_type * keys = nullptr;
+            const value_type * layout = nullptr;
+            const uint64_t * ranks = nullptr;
+        };
+
+        static mapped_tree open_mmap(const std::string & path) {
+            static_assert(std::is_trivially_copyable_v<value_type>, "Only trivially copyable values can be mapped");
+            return mapped_tree(path);
+        }
+
+        // Rebuilds a mutable tree from the sorted key block in O(n), no comparisons nor rotations are done.
+        static AVLTree load(const std::string & path) {
+            mapped_tree mapped = open_mmap(path);
+            AVLTree tree;
+            tree.buildSorted(mapped.begin(), mapped.end());
+            return tree;
+        }
+
+#endif
+        //</editor-fold>
+
         //<editor-fold desc="Iterators">
         iterator begin() {
             sus_ptr<Node> current = firstNode();
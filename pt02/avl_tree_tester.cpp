@@ -8,6 +8,8 @@
 #include <ctime>
 #include <source_location>
 #include <random>
+#include <unordered_map>
+#include <filesystem>
 
 using namespace stl;
 using namespace std;
@@ -675,6 +677,97 @@ void test_random_access() {
     }, std::source_location::current());
 }
 
+void test_serialize() {
+    testbed([](size_t i, const string & test_name) {
+        AVLTree<size_t> a;
+        set<size_t> b;
+        for (size_t j = 0; j < i; ++j) {
+            size_t random = rng();
+            a.insert(random);
+            b.insert(random);
+        }
+        string path = (std::filesystem::temp_directory_path() / "avl_tree_tester.bin").string();
+        a.save(path, i % 2 == 0);
+
+        AVLTree<size_t> loaded = AVLTree<size_t>::load(path);
+        if (!iterative_data_test<AVLTree<size_t> &, std::set<size_t> &>(loaded, b, test_name)) return false;
+        for (size_t j = 0; j < b.size(); ++j) {
+            if (*loaded[j] != *std::next(b.begin(), (long) j)) {
+                tests[test_name] = string_format("loaded tree random access differs at %zu", j);
+                return false;
+            }
+        }
+
+        auto mapped = AVLTree<size_t>::open_mmap(path);
+        const set<size_t> saved = b;
+        if (!std::equal(mapped.begin(), mapped.end(), saved.begin(), saved.end())) {
+            tests[test_name] = "mapped content differs";
+            return false;
+        }
+        for (size_t j = 0; j < i; ++j) {
+            size_t random = rng();
+            auto found = mapped.lower_bound(random);
+            auto ref = saved.lower_bound(random);
+            if ((found == mapped.end()) != (ref == saved.end()) || (ref != saved.end() && *found != *ref)) {
+                tests[test_name] = string_format("lower_bound(%zu) differs", random);
+                return false;
+            }
+            if (mapped.count(random) != saved.count(random)) {
+                tests[test_name] = string_format("count(%zu) differs", random);
+                return false;
+            }
+            loaded.insert(random);
+            b.insert(random);
+        }
+        if (!iterative_data_test<AVLTree<size_t> &, std::set<size_t> &>(loaded, b, test_name)) return false;
+        std::filesystem::remove(path);
+        return true;
+    }, std::source_location::current());
+}
+
+void test_aggregate() {
+    testbed([](size_t i, const string & test_name) {
+        AVLTree<size_t, std::less<size_t>, monoid::sum<size_t>> sum;
+        AVLTree<size_t, std::less<size_t>, monoid::min<size_t>> min;
+        AVLTree<size_t, std::less<size_t>, monoid::max<size_t>> max;
+        set<size_t> b;
+        for (size_t j = 0; j < 3 * i; ++j) {
+            size_t random = rng();
+            if (j % 3 == 2) {
+                sum.remove(random);
+                min.remove(random);
+                max.remove(random);
+                b.erase(random);
+            } else {
+                sum.insert(random);
+                min.insert(random);
+                max.insert(random);
+                b.insert(random);
+            }
+        }
+        auto copy = sum;
+        for (size_t j = 0; j < i; ++j) {
+            size_t low = rng(), high = rng();
+            size_t ref_sum = 0, ref_min = std::numeric_limits<size_t>::max(), ref_max = 0;
+            for (auto it = b.lower_bound(low); it != b.end() && *it < high; ++it) {
+                ref_sum += *it;
+                ref_min = std::min(ref_min, *it);
+                ref_max = std::max(ref_max, *it);
+            }
+            if (sum.aggregate(low, high) != ref_sum || copy.aggregate(low, high) != ref_sum) {
+                tests[test_name] = string_format("sum [%zu, %zu) %zu != %zu", low, high, sum.aggregate(low, high),
+                                                 ref_sum);
+                return false;
+            }
+            if (min.aggregate(low, high) != ref_min || max.aggregate(low, high) != ref_max) {
+                tests[test_name] = string_format("min/max [%zu, %zu) differ", low, high);
+                return false;
+            }
+        }
+        return true;
+    }, std::source_location::current());
+}
+
 
 int main() {
     std::random_device rd;
@@ -704,6 +797,8 @@ int main() {
     test_find();
     test_delete();
     test_random_access();
+    test_serialize();
+    test_aggregate();
 
     bool failed = false;
     for (auto & [key, error] : tests) {
@@ -0,0 +1,489 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#ifdef AVL_TREE_TESTING
+
+#include <cassert>
+
+#endif
+
+#include "avl_tree.hpp"
+
+namespace stl {
+
+    /**
+     * AVL set shared between many readers and a few writers.
+     *
+     * Readers never take a lock: they descend with optimistic lock coupling, i.e. they read the version of every
+     * node they pass and re-validate the parent's version after following a child pointer. A writer "locks" a node by
+     * making its version odd and bumps it again on unlock, so any reader that raced with the change restarts from
+     * the root. Only the nodes whose children change during `rotate` and the physical unlink in `remove` are locked,
+     * height updates in `updateUp` are writer-private and invisible to readers.
+     *
+     * Writers are serialized between themselves by a mutex (we have one or two of them), which keeps the writer side
+     * simple. Removal is logical first (Bronson style routing nodes): a node with two children only clears its
+     * `present` flag and stays in the tree, so values are never moved between nodes under a reader's hands. Nodes
+     * with at most one child are unlinked and handed to a small epoch based reclamation scheme.
+     */
+#if __cplusplus >= 202002L
+
+    template<typename T, typename Compare=std::compare_three_way>
+#else
+
+    template<typename T, typename Compare=std::less<T>>
+#endif
+    class ConcurrentAVLTree {
+        struct Node;
+
+      public:
+        using value_type = T;
+        using const_value_reference = const T &;
+        using size_type = size_t;
+        using value_compare = Compare;
+        using version_type = uint64_t;
+
+        static constexpr size_type reader_stripes = 64;
+
+      private:
+
+        struct Node {
+            Node() = default;
+
+            template<typename... M>
+            explicit Node(std::in_place_t, M && ... args) : data(std::forward<M>(args)...) {}
+
+            // Only the header node is constructed without a value.
+            std::optional<value_type> data;
+
+            std::atomic<sus_ptr<Node>> left = nullptr;
+            std::atomic<sus_ptr<Node>> right = nullptr;
+            std::atomic<version_type> version = 0;
+            std::atomic<bool> present = true;
+
+            // Writer private, readers never look at these.
+            sus_ptr<Node> parent = nullptr;
+            int maxDepth = 1;
+
+            const_value_reference dataRef() const {
+                return *data;
+            }
+
+            std::atomic<sus_ptr<Node>> & child(bool right_side) {
+                return right_side ? right : left;
+            }
+
+            static int depth(const sus_ptr<Node> node) {
+                return node ? node->maxDepth : 0;
+            }
+
+            void updateMaxDepth() {
+                maxDepth = std::max(depth(left.load(std::memory_order_relaxed)),
+                                    depth(right.load(std::memory_order_relaxed))) + 1;
+            }
+
+            int sign() const {
+                return depth(right.load(std::memory_order_relaxed)) - depth(left.load(std::memory_order_relaxed));
+            }
+
+            size_type childCount() const {
+                return (left.load(std::memory_order_relaxed) != nullptr) +
+                       (right.load(std::memory_order_relaxed) != nullptr);
+            }
+
+            bool isRightChild() const {
+                return parent->right.load(std::memory_order_relaxed) == this;
+            }
+        };
+
+        //<editor-fold desc="Versions">
+        static bool isLocked(version_type version) {
+            return version & 1;
+        }
+
+        static version_type readVersion(const Node & node) {
+            version_type version = node.version.load(std::memory_order_acquire);
+            while (isLocked(version)) {
+                std::this_thread::yield();
+                version = node.version.load(std::memory_order_acquire);
+            }
+            return version;
+        }
+
+        static bool validate(const Node & node, version_type version) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return node.version.load(std::memory_order_relaxed) == version;
+        }
+
+        static void lock(Node & node) {
+            node.version.fetch_add(1, std::memory_order_acq_rel);
+        }
+
+        static void unlock(Node & node) {
+            node.version.fetch_add(1, std::memory_order_release);
+        }
+        //</editor-fold>
+
+        //<editor-fold desc="Epoch based reclamation">
+        struct alignas(64) ReaderStripe {
+            std::atomic<size_type> active = 0;
+        };
+
+        std::atomic<version_type> epoch = 1;
+        mutable std::array<std::array<ReaderStripe, reader_stripes>, 2> readers;
+        std::array<std::vector<sus_ptr<Node>>, 2> retired;
+
+        static size_type readerStripe() {
+            static std::atomic<size_type> next_stripe = 0;
+            static thread_local size_type stripe = next_stripe.fetch_add(1) % reader_stripes;
+            return stripe;
+        }
+
+        struct ReadGuard {
+            explicit ReadGuard(const ConcurrentAVLTree & tree) {
+                size_type stripe = readerStripe();
+                while (true) {
+                    version_type current = tree.epoch.load();
+                    counter = &tree.readers[current & 1][stripe].active;
+                    counter->fetch_add(1);
+                    if (tree.epoch.load() == current) break;
+                    counter->fetch_sub(1);
+                }
+            }
+
+            ~ReadGuard() {
+                counter->fetch_sub(1, std::memory_order_release);
+            }
+
+            ReadGuard(const ReadGuard &) = delete;
+
+            ReadGuard & operator=(const ReadGuard &) = delete;
+
+            std::atomic<size_type> * counter;
+        };
+
+        bool quiescent(size_type parity) const {
+            for (const ReaderStripe & stripe: readers[parity]) {
+                if (stripe.active.load()) return false;
+            }
+            return true;
+        }
+
+        void retire(sus_ptr<Node> node) {
+            retired[epoch.load() & 1].push_back(node);
+            tryReclaim();
+        }
+
+        void tryReclaim() {
+            version_type current = epoch.load();
+            size_type previous = (current + 1) & 1;
+            if (!quiescent(previous)) return;
+            for (sus_ptr<Node> node: retired[previous]) {
+                delete node;
+            }
+            retired[previous].clear();
+            epoch.store(current + 1);
+        }
+        //</editor-fold>
+
+        mutable std::mutex writer_mutex;
+        value_compare comparator = {};
+        Node header;
+        std::atomic<size_type> element_count = 0;
+
+        // -1 if a < b, 1 if a > b and 0 if they are equivalent
+        int three_way_compare(const value_type & a, const value_type & b) const {
+#if __cplusplus >= 202002L
+            if constexpr (std::is_convertible_v<std::invoke_result_t<decltype(comparator), value_type, value_type>, std::weak_ordering>) {
+                std::weak_ordering order = comparator(a, b);
+                return (order > 0) - (order < 0);
+            } else {
+#endif
+            static_assert(
+                    std::is_same<std::invoke_result_t<decltype(comparator), value_type, value_type>, bool>::value,
+                    "Must be either less functor or three way comparator!");
+            if (comparator(a, b)) return -1;
+            if (comparator(b, a)) return 1;
+            return 0;
+#if __cplusplus >= 202002L
+            }
+#endif
+        }
+
+        sus_ptr<Node> root() const {
+            return header.left.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Lock free lookup, returns the node holding an equivalent value (present or routing) or nullptr.
+         * The value read through the returned node stays valid for the lifetime of the surrounding ReadGuard.
+         */
+        sus_ptr<Node> optimisticFind(const value_type & value, bool & present) const {
+            restart:
+            const Node * parent = &header;
+            version_type parentVersion = readVersion(*parent);
+            sus_ptr<Node> current = parent->left.load(std::memory_order_acquire);
+            while (current) {
+                version_type version = readVersion(*current);
+                if (!validate(*parent, parentVersion)) goto restart;
+
+                int order = three_way_compare(value, current->dataRef());
+                if (order == 0) {
+                    present = current->present.load(std::memory_order_acquire);
+                    if (!validate(*current, version)) goto restart;
+                    return current;
+                }
+                sus_ptr<Node> next = (order < 0 ? current->left : current->right).load(std::memory_order_acquire);
+                parent = current;
+                parentVersion = version;
+                current = next;
+            }
+            if (!validate(*parent, parentVersion)) goto restart;
+            present = false;
+            return nullptr;
+        }
+
+        // Writer side lookup, `parent` ends at the last visited node when value is missing.
+        sus_ptr<Node> writerFind(const value_type & value, sus_ptr<Node> & parent, bool & right_side) {
+            parent = &header;
+            right_side = false;
+            sus_ptr<Node> current = root();
+            while (current) {
+                int order = three_way_compare(value, current->dataRef());
+                if (order == 0) return current;
+                parent = current;
+                right_side = order > 0;
+                current = current->child(right_side).load(std::memory_order_relaxed);
+            }
+            return nullptr;
+        }
+
+        /**
+         * Rotates `pivot` down in `direction` (left rotation when direction == false) and returns the node that
+         * took its place. Exactly the three nodes whose children change are locked.
+         */
+        sus_ptr<Node> rotate(sus_ptr<Node> pivot, bool right_rotation) {
+            sus_ptr<Node> parent = pivot->parent;
+            bool pivotRight = parent != &header && pivot->isRightChild();
+            // left rotation lifts the right child and vice versa
+            sus_ptr<Node> child = pivot->child(!right_rotation).load(std::memory_order_relaxed);
+            sus_ptr<Node> grandChild = child->child(right_rotation).load(std::memory_order_relaxed);
+
+            lock(*parent);
+            lock(*pivot);
+            lock(*child);
+
+            pivot->child(!right_rotation).store(grandChild, std::memory_order_release);
+            if (grandChild) grandChild->parent = pivot;
+
+            child->child(right_rotation).store(pivot, std::memory_order_release);
+            pivot->parent = child;
+
+            parent->child(pivotRight).store(child, std::memory_order_release);
+            child->parent = parent;
+
+            unlock(*child);
+            unlock(*pivot);
+            unlock(*parent);
+
+            pivot->updateMaxDepth();
+            child->updateMaxDepth();
+            return child;
+        }
+
+        void updateUp(sus_ptr<Node> from) {
+            sus_ptr<Node> current = from;
+            while (current != &header) {
+                int before = current->maxDepth;
+                current->updateMaxDepth();
+                int sign = current->sign();
+                if (sign < -1) {
+                    sus_ptr<Node> left = current->left.load(std::memory_order_relaxed);
+                    if (left->sign() > 0) rotate(left, false);
+                    current = rotate(current, true);
+                } else if (sign > 1) {
+                    sus_ptr<Node> right = current->right.load(std::memory_order_relaxed);
+                    if (right->sign() < 0) rotate(right, true);
+                    current = rotate(current, false);
+                } else if (before == current->maxDepth && current != from) {
+                    break;
+                }
+                current = current->parent;
+            }
+        }
+
+        // Physically removes a node with at most one child, returns its former parent.
+        sus_ptr<Node> unlink(sus_ptr<Node> node) {
+#ifdef AVL_TREE_TESTING
+            assert(node->childCount() < 2);
+#endif
+            sus_ptr<Node> parent = node->parent;
+            bool right_side = parent != &header && node->isRightChild();
+            sus_ptr<Node> child = node->left.load(std::memory_order_relaxed);
+            if (!child) child = node->right.load(std::memory_order_relaxed);
+
+            lock(*parent);
+            lock(*node);
+            parent->child(right_side).store(child, std::memory_order_release);
+            if (child) child->parent = parent;
+            unlock(*node);
+            unlock(*parent);
+            // readers standing on the node fail their next validation and restart from the root
+            retire(node);
+            return parent;
+        }
+
+        static void destroy(sus_ptr<Node> node) {
+            std::vector<sus_ptr<Node>> stack;
+            if (node) stack.push_back(node);
+            while (!stack.empty()) {
+                sus_ptr<Node> current = stack.back();
+                stack.pop_back();
+                if (auto left = current->left.load()) stack.push_back(left);
+                if (auto right = current->right.load()) stack.push_back(right);
+                delete current;
+            }
+        }
+
+        int verifyNode(const sus_ptr<Node> node, const sus_ptr<Node> parent, const value_type * low,
+                       const value_type * high, size_type & present) const {
+            if (!node) return 0;
+            if (node->parent != parent) return -1;
+            if (low && three_way_compare(*low, node->dataRef()) >= 0) return -1;
+            if (high && three_way_compare(node->dataRef(), *high) >= 0) return -1;
+            if (isLocked(node->version.load())) return -1;
+            present += node->present.load();
+            int left = verifyNode(node->left.load(), node, low, &node->dataRef(), present);
+            int right = verifyNode(node->right.load(), node, &node->dataRef(), high, present);
+            if (left < 0 || right < 0 || std::abs(left - right) > 1) return -1;
+            if (node->maxDepth != std::max(left, right) + 1) return -1;
+            return node->maxDepth;
+        }
+
+      public:
+
+        ConcurrentAVLTree() = default;
+
+        ConcurrentAVLTree(const ConcurrentAVLTree &) = delete;
+
+        ConcurrentAVLTree & operator=(const ConcurrentAVLTree &) = delete;
+
+        // Must not race with any reader or writer.
+        ~ConcurrentAVLTree() {
+            destroy(root());
+            for (auto & list: retired) {
+                for (sus_ptr<Node> node: list) delete node;
+            }
+        }
+
+        template<typename... M>
+        bool insert(M && ... arguments) {
+            auto node = std::make_unique<Node>(std::in_place, std::forward<M>(arguments)...);
+            std::lock_guard<std::mutex> guard(writer_mutex);
+
+            sus_ptr<Node> parent;
+            bool right_side;
+            sus_ptr<Node> found = writerFind(node->dataRef(), parent, right_side);
+            if (found) {
+                if (found->present.load(std::memory_order_relaxed)) return false;
+                found->present.store(true, std::memory_order_release);
+                element_count.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+
+            sus_ptr<Node> inserted = node.release();
+            inserted->parent = parent;
+            // linking a fresh leaf does not invalidate anything a reader already saw
+            parent->child(right_side).store(inserted, std::memory_order_release);
+            element_count.fetch_add(1, std::memory_order_relaxed);
+            if (parent != &header) updateUp(parent);
+            return true;
+        }
+
+        template<typename... M>
+        bool remove(M && ... arguments) {
+            value_type element(std::forward<M>(arguments)...);
+            std::lock_guard<std::mutex> guard(writer_mutex);
+
+            sus_ptr<Node> parent;
+            bool right_side;
+            sus_ptr<Node> found = writerFind(element, parent, right_side);
+            if (!found || !found->present.load(std::memory_order_relaxed)) return false;
+            found->present.store(false, std::memory_order_release);
+            element_count.fetch_sub(1, std::memory_order_relaxed);
+
+            // Two children: keep it as a routing node. Otherwise unlink it together with any routing parents
+            // which were only kept alive because of it.
+            sus_ptr<Node> current = found;
+            while (current != &header && !current->present.load(std::memory_order_relaxed) &&
+                   current->childCount() < 2) {
+                current = unlink(current);
+            }
+            if (current != &header) updateUp(current);
+            return true;
+        }
+
+        bool contains(const value_type & value) const {
+            ReadGuard guard(*this);
+            bool present;
+            optimisticFind(value, present);
+            return present;
+        }
+
+        std::optional<value_type> find(const value_type & value) const {
+            ReadGuard guard(*this);
+            bool present;
+            sus_ptr<Node> node = optimisticFind(value, present);
+            if (!present) return std::nullopt;
+            return node->dataRef();
+        }
+
+        size_type count(const value_type & value) const {
+            return contains(value);
+        }
+
+        size_type size() const {
+            return element_count.load(std::memory_order_relaxed);
+        }
+
+        bool empty() const {
+            return !size();
+        }
+
+        /**
+         * Checks BST order, parent links, depths and AVL balance of the physical tree and that the number of
+         * present nodes matches size(). Takes the writer lock, call it once readers are quiet.
+         */
+        bool verify() const {
+            std::lock_guard<std::mutex> guard(writer_mutex);
+            size_type present = 0;
+            if (verifyNode(root(), const_cast<sus_ptr<Node>>(&header), nullptr, nullptr, present) < 0) return false;
+            return present == size();
+        }
+
+        // Calls fun for every present value in order. Writer side, must not race with writers.
+        template<typename Function>
+        void forEach(Function && fun) const {
+            std::lock_guard<std::mutex> guard(writer_mutex);
+            std::vector<sus_ptr<Node>> stack;
+            sus_ptr<Node> current = root();
+            while (current || !stack.empty()) {
+                while (current) {
+                    stack.push_back(current);
+                    current = current->left.load();
+                }
+                current = stack.back();
+                stack.pop_back();
+                if (current->present.load()) fun(current->dataRef());
+                current = current->right.load();
+            }
+        }
+    };
+}
@@ -0,0 +1,145 @@
+#define AVL_TREE_TESTING 1
+
+#include "./concurrent_avl_tree.hpp"
+#include <set>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <thread>
+
+using namespace stl;
+using namespace std;
+
+using tree_t = ConcurrentAVLTree<size_t, std::less<size_t>>;
+
+size_t KEY_SPACE = 20'000;
+
+// keeps the lookups in the throughput loop observable
+std::atomic<size_t> found_sink = 0;
+
+/**
+ * Even keys are inserted up front and never touched again, so every reader must always see them. Odd keys are
+ * churned by the writers, each writer owning the odd keys congruent to its id so it can keep its own reference set.
+ */
+bool stress(size_t reader_count, size_t writer_count, std::chrono::milliseconds duration) {
+    tree_t tree;
+    for (size_t i = 0; i < KEY_SPACE; i += 2) tree.insert(i);
+
+    std::atomic<bool> stop = false;
+    std::atomic<size_t> reader_errors = 0;
+    std::vector<std::set<size_t>> owned(writer_count);
+    std::vector<std::thread> threads;
+
+    for (size_t w = 0; w < writer_count; ++w) {
+        threads.emplace_back([&, w]() {
+            std::mt19937 rng(1234 + w);
+            std::set<size_t> & mine = owned[w];
+            while (!stop.load()) {
+                size_t key = (rng() % (KEY_SPACE / 2 / writer_count)) * 2 * writer_count + 2 * w + 1;
+                if (rng() % 2) {
+                    if (tree.insert(key) != mine.insert(key).second) reader_errors++;
+                } else {
+                    if (tree.remove(key) != (bool) mine.erase(key)) reader_errors++;
+                }
+            }
+        });
+    }
+
+    for (size_t r = 0; r < reader_count; ++r) {
+        threads.emplace_back([&, r]() {
+            std::mt19937 rng(42 + r);
+            while (!stop.load()) {
+                size_t key = rng() % KEY_SPACE;
+                bool found = tree.contains(key);
+                if (key % 2 == 0 && !found) reader_errors++;
+                if (key % 2 == 0 && tree.find(key) != key) reader_errors++;
+            }
+        });
+    }
+
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto & thread: threads) thread.join();
+
+    if (reader_errors) {
+        cout << "Failed: " << reader_errors << " inconsistent results" << endl;
+        return false;
+    }
+    if (!tree.verify()) {
+        cout << "Failed: AVL invariants broken" << endl;
+        return false;
+    }
+
+    std::set<size_t> expected;
+    for (size_t i = 0; i < KEY_SPACE; i += 2) expected.insert(i);
+    for (auto & mine: owned) expected.insert(mine.begin(), mine.end());
+    std::vector<size_t> actual;
+    tree.forEach([&actual](size_t value) { actual.push_back(value); });
+    if (!std::equal(actual.begin(), actual.end(), expected.begin(), expected.end()) ||
+        tree.size() != expected.size()) {
+        cout << "Failed: content differs from the writers' reference sets" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Lookups per second summed over all readers while `writer_count` writers keep churning the tree.
+double read_throughput(size_t reader_count, size_t writer_count, std::chrono::milliseconds duration) {
+    tree_t tree;
+    for (size_t i = 0; i < KEY_SPACE; ++i) tree.insert(i);
+
+    std::atomic<bool> stop = false;
+    std::atomic<size_t> lookups = 0;
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < writer_count; ++w) {
+        threads.emplace_back([&, w]() {
+            std::mt19937 rng(7 + w);
+            while (!stop.load()) {
+                size_t key = rng() % KEY_SPACE;
+                tree.remove(key);
+                tree.insert(key);
+            }
+        });
+    }
+    for (size_t r = 0; r < reader_count; ++r) {
+        threads.emplace_back([&, r]() {
+            std::mt19937 rng(99 + r);
+            size_t local = 0, hits = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                for (int i = 0; i < 256; ++i, ++local) hits += tree.contains(rng() % KEY_SPACE);
+            }
+            lookups += local;
+            found_sink += hits;
+        });
+    }
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto & thread: threads) thread.join();
+    return double(lookups) / std::chrono::duration<double>(duration).count();
+}
+
+int main() {
+    size_t hardware = std::max(2u, std::thread::hardware_concurrency());
+    bool failed = false;
+
+    for (size_t writers: {1, 2}) {
+        for (size_t readers: {size_t(1), hardware, 4 * hardware}) {
+            cout << "Stress " << readers << " readers, " << writers << " writers: " << flush;
+            bool ok = stress(readers, writers, std::chrono::milliseconds(500));
+            failed |= !ok;
+            if (ok) cout << "Pog" << endl;
+        }
+    }
+
+    cout << endl << "Read throughput with 1 writer (" << KEY_SPACE << " keys)" << endl;
+    for (size_t readers = 1; readers <= 2 * hardware; readers *= 2) {
+        double perSecond = read_throughput(readers, 1, std::chrono::milliseconds(1000));
+        cout << std::setw(4) << readers << " readers: " << std::fixed << std::setprecision(2)
+             << perSecond / 1e6 << " M lookups/s" << endl;
+    }
+
+    if (failed) std::cout << "Failed at least one!" << endl;
+    return failed;
+}